@@ -0,0 +1,9 @@
+file(REMOVE_RECURSE
+  "/root/repo/build-info.h"
+  "CMakeFiles/BUILD_INFO"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang )
+  include(CMakeFiles/BUILD_INFO.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,22 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/ggml-alloc.c" "CMakeFiles/ggml.dir/ggml-alloc.c.o" "gcc" "CMakeFiles/ggml.dir/ggml-alloc.c.o.d"
+  "/root/repo/ggml-quants.c" "CMakeFiles/ggml.dir/ggml-quants.c.o" "gcc" "CMakeFiles/ggml.dir/ggml-quants.c.o.d"
+  "/root/repo/ggml.c" "CMakeFiles/ggml.dir/ggml.c.o" "gcc" "CMakeFiles/ggml.dir/ggml.c.o.d"
+  "/root/repo/k_quants.c" "CMakeFiles/ggml.dir/k_quants.c.o" "gcc" "CMakeFiles/ggml.dir/k_quants.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/ggml.dir/ggml-alloc.c.o"
+  "CMakeFiles/ggml.dir/ggml-alloc.c.o.d"
+  "CMakeFiles/ggml.dir/ggml-quants.c.o"
+  "CMakeFiles/ggml.dir/ggml-quants.c.o.d"
+  "CMakeFiles/ggml.dir/ggml.c.o"
+  "CMakeFiles/ggml.dir/ggml.c.o.d"
+  "CMakeFiles/ggml.dir/k_quants.c.o"
+  "CMakeFiles/ggml.dir/k_quants.c.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/ggml.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/llama.dir/llama.cpp.o"
+  "CMakeFiles/llama.dir/llama.cpp.o.d"
+  "libllama.a"
+  "libllama.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C CXX)
+  include(CMakeFiles/llama.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
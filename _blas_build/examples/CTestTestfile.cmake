@@ -0,0 +1,17 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/examples
+# Build directory: /root/repo/_blas_build/examples
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+subdirs("main")
+subdirs("quantize")
+subdirs("quantize-stats")
+subdirs("perplexity")
+subdirs("embedding")
+subdirs("save-load-state")
+subdirs("benchmark")
+subdirs("baby-llama")
+subdirs("train-text-from-scratch")
+subdirs("simple")
+subdirs("speculative")
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/baby-llama"
+  "../../bin/baby-llama.pdb"
+  "CMakeFiles/baby-llama.dir/baby-llama.cpp.o"
+  "CMakeFiles/baby-llama.dir/baby-llama.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/baby-llama.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
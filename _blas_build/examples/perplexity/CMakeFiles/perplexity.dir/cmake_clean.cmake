@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/perplexity"
+  "../../bin/perplexity.pdb"
+  "CMakeFiles/perplexity.dir/perplexity.cpp.o"
+  "CMakeFiles/perplexity.dir/perplexity.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/perplexity.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
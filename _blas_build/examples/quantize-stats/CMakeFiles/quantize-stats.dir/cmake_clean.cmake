@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/quantize-stats"
+  "../../bin/quantize-stats.pdb"
+  "CMakeFiles/quantize-stats.dir/quantize-stats.cpp.o"
+  "CMakeFiles/quantize-stats.dir/quantize-stats.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/quantize-stats.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/quantize"
+  "../../bin/quantize.pdb"
+  "CMakeFiles/quantize.dir/quantize.cpp.o"
+  "CMakeFiles/quantize.dir/quantize.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/quantize.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
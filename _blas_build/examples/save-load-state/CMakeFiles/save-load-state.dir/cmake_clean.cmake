@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/save-load-state"
+  "../../bin/save-load-state.pdb"
+  "CMakeFiles/save-load-state.dir/save-load-state.cpp.o"
+  "CMakeFiles/save-load-state.dir/save-load-state.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/save-load-state.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
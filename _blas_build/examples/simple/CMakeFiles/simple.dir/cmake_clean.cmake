@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/simple"
+  "../../bin/simple.pdb"
+  "CMakeFiles/simple.dir/simple.cpp.o"
+  "CMakeFiles/simple.dir/simple.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/simple.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
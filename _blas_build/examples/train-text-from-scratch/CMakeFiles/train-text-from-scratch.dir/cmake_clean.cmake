@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/train-text-from-scratch"
+  "../../bin/train-text-from-scratch.pdb"
+  "CMakeFiles/train-text-from-scratch.dir/train-text-from-scratch.cpp.o"
+  "CMakeFiles/train-text-from-scratch.dir/train-text-from-scratch.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/train-text-from-scratch.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,6 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/examples/train-text-from-scratch
+# Build directory: /root/repo/_blas_build/examples/train-text-from-scratch
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
@@ -0,0 +1,7 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/pocs
+# Build directory: /root/repo/_blas_build/pocs
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+subdirs("vdot")
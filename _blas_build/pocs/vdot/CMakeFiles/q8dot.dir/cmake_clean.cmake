@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/q8dot"
+  "../../bin/q8dot.pdb"
+  "CMakeFiles/q8dot.dir/q8dot.cpp.o"
+  "CMakeFiles/q8dot.dir/q8dot.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/q8dot.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../../bin/vdot"
+  "../../bin/vdot.pdb"
+  "CMakeFiles/vdot.dir/vdot.cpp.o"
+  "CMakeFiles/vdot.dir/vdot.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/vdot.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
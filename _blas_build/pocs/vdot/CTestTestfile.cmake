@@ -0,0 +1,6 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/pocs/vdot
+# Build directory: /root/repo/_blas_build/pocs/vdot
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
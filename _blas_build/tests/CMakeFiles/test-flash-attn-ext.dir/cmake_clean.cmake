@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/test-flash-attn-ext"
+  "../bin/test-flash-attn-ext.pdb"
+  "CMakeFiles/test-flash-attn-ext.dir/test-flash-attn-ext.c.o"
+  "CMakeFiles/test-flash-attn-ext.dir/test-flash-attn-ext.c.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test-flash-attn-ext.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
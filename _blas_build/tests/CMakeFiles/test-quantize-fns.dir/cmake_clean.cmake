@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/test-quantize-fns"
+  "../bin/test-quantize-fns.pdb"
+  "CMakeFiles/test-quantize-fns.dir/test-quantize-fns.cpp.o"
+  "CMakeFiles/test-quantize-fns.dir/test-quantize-fns.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test-quantize-fns.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
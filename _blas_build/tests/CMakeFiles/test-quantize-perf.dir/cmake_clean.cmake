@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/test-quantize-perf"
+  "../bin/test-quantize-perf.pdb"
+  "CMakeFiles/test-quantize-perf.dir/test-quantize-perf.cpp.o"
+  "CMakeFiles/test-quantize-perf.dir/test-quantize-perf.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test-quantize-perf.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
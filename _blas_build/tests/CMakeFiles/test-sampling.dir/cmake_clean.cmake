@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/test-sampling"
+  "../bin/test-sampling.pdb"
+  "CMakeFiles/test-sampling.dir/test-sampling.cpp.o"
+  "CMakeFiles/test-sampling.dir/test-sampling.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test-sampling.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/test-state"
+  "../bin/test-state.pdb"
+  "CMakeFiles/test-state.dir/test-state.cpp.o"
+  "CMakeFiles/test-state.dir/test-state.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test-state.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
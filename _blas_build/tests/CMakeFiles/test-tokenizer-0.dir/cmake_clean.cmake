@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "../bin/test-tokenizer-0"
+  "../bin/test-tokenizer-0.pdb"
+  "CMakeFiles/test-tokenizer-0.dir/test-tokenizer-0.cpp.o"
+  "CMakeFiles/test-tokenizer-0.dir/test-tokenizer-0.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/test-tokenizer-0.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
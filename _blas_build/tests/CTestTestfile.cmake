@@ -0,0 +1,18 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests
+# Build directory: /root/repo/_blas_build/tests
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(test-quantize-fns "/root/repo/_blas_build/bin/test-quantize-fns")
+set_tests_properties(test-quantize-fns PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;9;llama_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(test-quantize-perf "/root/repo/_blas_build/bin/test-quantize-perf")
+set_tests_properties(test-quantize-perf PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;10;llama_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(test-sampling "/root/repo/_blas_build/bin/test-sampling")
+set_tests_properties(test-sampling PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;11;llama_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(test-state "/root/repo/_blas_build/bin/test-state")
+set_tests_properties(test-state PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;12;llama_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(test-flash-attn-ext "/root/repo/_blas_build/bin/test-flash-attn-ext")
+set_tests_properties(test-flash-attn-ext PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;13;llama_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(test-tokenizer-0 "/root/repo/_blas_build/bin/test-tokenizer-0" "/root/repo/tests/../models/ggml-vocab.bin")
+set_tests_properties(test-tokenizer-0 PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;14;llama_add_test;/root/repo/tests/CMakeLists.txt;0;")
@@ -0,0 +1,7 @@
+#ifndef BUILD_INFO_H
+#define BUILD_INFO_H
+
+#define BUILD_NUMBER 34
+#define BUILD_COMMIT "79fd291"
+
+#endif // BUILD_INFO_H
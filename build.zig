@@ -15,6 +15,8 @@ pub fn build(b: *std.build.Builder) void {
     lib.addIncludePath("./examples");
     lib.addCSourceFiles(&.{
         "ggml.c",
+        "ggml-quants.c",
+        "ggml-alloc.c",
     }, &.{"-std=c11"});
     lib.addCSourceFiles(&.{
         "llama.cpp",
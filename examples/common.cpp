@@ -92,6 +92,23 @@ void process_escapes(std::string& input) {
     input.resize(output_idx);
 }
 
+ggml_type kv_cache_type_from_str(const std::string & s) {
+    if (s == "f32") {
+        return GGML_TYPE_F32;
+    }
+    if (s == "f16") {
+        return GGML_TYPE_F16;
+    }
+    if (s == "q8_0") {
+        return GGML_TYPE_Q8_0;
+    }
+    if (s == "q4_0") {
+        return GGML_TYPE_Q4_0;
+    }
+
+    return GGML_TYPE_COUNT;
+}
+
 bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
     bool invalid_param = false;
     bool escape_prompt = false;
@@ -117,6 +134,14 @@ bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
                 break;
             }
             params.n_threads = std::stoi(argv[i]);
+        } else if (arg == "-tb" || arg == "--threads-batch") {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.n_threads_batch = std::stoi(argv[i]);
+        } else if (arg == "--calibrate") {
+            params.calibrate = true;
         } else if (arg == "-p" || arg == "--prompt") {
             if (++i >= argc) {
                 invalid_param = true;
@@ -169,7 +194,32 @@ bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
             }
             params.n_ctx = std::stoi(argv[i]);
         } else if (arg == "--memory-f32") {
-            params.memory_f16 = false;
+            params.cache_type_k = "f32";
+            params.cache_type_v = "f32";
+        } else if (arg == "--no-flash-attn" || arg == "-nfa") {
+            params.flash_attn = false;
+        } else if (arg == "--v-transposed") {
+            params.v_rows = false;
+        } else if (arg == "--cache-type-k" || arg == "-ctk") {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.cache_type_k = argv[i];
+            if (kv_cache_type_from_str(params.cache_type_k) == GGML_TYPE_COUNT) {
+                invalid_param = true;
+                break;
+            }
+        } else if (arg == "--cache-type-v" || arg == "-ctv") {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.cache_type_v = argv[i];
+            if (kv_cache_type_from_str(params.cache_type_v) == GGML_TYPE_COUNT) {
+                invalid_param = true;
+                break;
+            }
         } else if (arg == "--top-p") {
             if (++i >= argc) {
                 invalid_param = true;
@@ -255,6 +305,18 @@ bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
                 break;
             }
             params.model = argv[i];
+        } else if (arg == "-md" || arg == "--model-draft") {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.model_draft = argv[i];
+        } else if (arg == "--draft") {
+            if (++i >= argc) {
+                invalid_param = true;
+                break;
+            }
+            params.n_draft = std::stoi(argv[i]);
         } else if (arg == "-a" || arg == "--alias") {
             if (++i >= argc) {
                 invalid_param = true;
@@ -341,6 +403,10 @@ bool gpt_params_parse(int argc, char ** argv, gpt_params & params) {
 #endif // GGML_USE_CUBLAS
         } else if (arg == "--no-mmap") {
             params.use_mmap = false;
+        } else if (arg == "--repack") {
+            params.repack = true;
+        } else if (arg == "--concat-weights") {
+            params.concat_weights = true;
         } else if (arg == "--mtest") {
             params.mem_test = true;
         } else if (arg == "--numa") {
@@ -445,6 +511,9 @@ void gpt_print_usage(int /*argc*/, char ** argv, const gpt_params & params) {
     fprintf(stderr, "  --color               colorise output to distinguish prompt and user input from generations\n");
     fprintf(stderr, "  -s SEED, --seed SEED  RNG seed (default: -1, use random seed for < 0)\n");
     fprintf(stderr, "  -t N, --threads N     number of threads to use during computation (default: %d)\n", params.n_threads);
+    fprintf(stderr, "  -tb N, --threads-batch N\n");
+    fprintf(stderr, "                        number of threads to use for batches of more than one token (default: same as --threads)\n");
+    fprintf(stderr, "  --calibrate           measure the cost of compute, memory and threads on this host to choose the threads of each op\n");
     fprintf(stderr, "  -p PROMPT, --prompt PROMPT\n");
     fprintf(stderr, "                        prompt to start generation with (default: empty)\n");
     fprintf(stderr, "  -e                    process prompt escapes sequences (\\n, \\r, \\t, \\', \\\", \\\\)\n");
@@ -480,6 +549,12 @@ void gpt_print_usage(int /*argc*/, char ** argv, const gpt_params & params) {
     fprintf(stderr, "  --no-penalize-nl      do not penalize newline token\n");
     fprintf(stderr, "  --memory-f32          use f32 instead of f16 for memory key+value (default: disabled)\n");
     fprintf(stderr, "                        not recommended: doubles context memory required and no measurable increase in quality\n");
+    fprintf(stderr, "  -ctk TYPE, --cache-type-k TYPE\n");
+    fprintf(stderr, "                        KV cache data type for K: f32, f16, q8_0 or q4_0 (default: %s)\n", params.cache_type_k.c_str());
+    fprintf(stderr, "  -ctv TYPE, --cache-type-v TYPE\n");
+    fprintf(stderr, "                        KV cache data type for V: f32, f16, q8_0 or q4_0 (default: %s)\n", params.cache_type_v.c_str());
+    fprintf(stderr, "  -nfa, --no-flash-attn compute the attention with separate ops instead of the fused one\n");
+    fprintf(stderr, "  --v-transposed        store the V cache transposed instead of one row per token\n");
     fprintf(stderr, "  --temp N              temperature (default: %.1f)\n", (double)params.temp);
     fprintf(stderr, "  -b N, --batch-size N  batch size for prompt processing (default: %d)\n", params.n_batch);
     fprintf(stderr, "  --perplexity          compute perplexity over the prompt\n");
@@ -490,6 +565,8 @@ void gpt_print_usage(int /*argc*/, char ** argv, const gpt_params & params) {
     if (llama_mmap_supported()) {
         fprintf(stderr, "  --no-mmap             do not memory-map model (slower load but may reduce pageouts if not using mlock)\n");
     }
+    fprintf(stderr, "  --repack              repack the weights for the CPU matrix multiplication, cached in MODEL.repack\n");
+    fprintf(stderr, "  --concat-weights      concatenate the Q, K, V and the gate, up weights to multiply each group at once\n");
     fprintf(stderr, "  --numa                attempt optimizations that help on some NUMA systems\n");
     fprintf(stderr, "                        if run without this previously, it is recommended to drop the system page cache before using this\n");
     fprintf(stderr, "                        see https://github.com/ggerganov/llama.cpp/issues/1437\n");
@@ -508,6 +585,9 @@ void gpt_print_usage(int /*argc*/, char ** argv, const gpt_params & params) {
     fprintf(stderr, "  --lora-base FNAME     optional model to use as a base for the layers modified by the LoRA adapter\n");
     fprintf(stderr, "  -m FNAME, --model FNAME\n");
     fprintf(stderr, "                        model path (default: %s)\n", params.model.c_str());
+    fprintf(stderr, "  -md FNAME, --model-draft FNAME\n");
+    fprintf(stderr, "                        draft model for speculative decoding (default: unused)\n");
+    fprintf(stderr, "  --draft N             number of tokens to draft for speculative decoding (default: %d)\n", params.n_draft);
     fprintf(stderr, "\n");
 }
 
@@ -551,11 +631,19 @@ std::tuple<struct llama_model *, struct llama_context *> llama_init_from_gpt_par
     memcpy(lparams.tensor_split, params.tensor_split, LLAMA_MAX_DEVICES*sizeof(float));
     lparams.low_vram     = params.low_vram;
     lparams.seed         = params.seed;
-    lparams.f16_kv       = params.memory_f16;
+    lparams.type_k       = kv_cache_type_from_str(params.cache_type_k);
+    lparams.type_v       = kv_cache_type_from_str(params.cache_type_v);
     lparams.use_mmap     = params.use_mmap;
     lparams.use_mlock    = params.use_mlock;
     lparams.logits_all   = params.perplexity;
     lparams.embedding    = params.embedding;
+    lparams.flash_attn   = params.flash_attn;
+    lparams.v_rows       = params.v_rows;
+    lparams.calibrate    = params.calibrate;
+    lparams.n_threads    = params.n_threads;
+    lparams.n_threads_batch = params.n_threads_batch > 0 ? params.n_threads_batch : params.n_threads;
+    lparams.repack       = params.repack && params.lora_adapter.empty(); // the adapters cannot be applied to repacked weights
+    lparams.concat_weights = params.concat_weights;
 
     llama_model * model  = llama_load_model_from_file(params.model.c_str(), lparams);
     if (model == NULL) {
@@ -24,10 +24,12 @@ int32_t get_num_physical_cores();
 struct gpt_params {
     int32_t seed                            = -1;  // RNG seed
     int32_t n_threads                       = get_num_physical_cores();
+    int32_t n_threads_batch                 = -1;  // number of threads for batches of more than one token (-1 = n_threads)
     int32_t n_predict                       = -1;  // new tokens to predict
     int32_t n_ctx                           = 512; // context size
     int32_t n_batch                         = 512; // batch size for prompt processing (must be >=32 to use BLAS)
     int32_t n_keep                          = 0;   // number of tokens to keep from initial prompt
+    int32_t n_draft                         = 16;  // number of tokens to draft during speculative decoding
     int32_t n_gpu_layers                    = 0;   // number of layers to store in VRAM
     int32_t main_gpu                        = 0;   // the GPU that is used for scratch and small tensors
     float   tensor_split[LLAMA_MAX_DEVICES] = {0}; // how split tensors should be distributed across GPUs
@@ -49,6 +51,7 @@ struct gpt_params {
     float   mirostat_eta      = 0.10f; // learning rate
 
     std::string model             = "models/7B/ggml-model.bin"; // model path
+    std::string model_draft       = "";  // draft model for speculative decoding
     std::string model_alias       = "unknown"; // model alias
     std::string prompt            = "";
     std::string path_prompt_cache = "";  // path to file for saving/loading prompt eval state
@@ -59,7 +62,9 @@ struct gpt_params {
     std::string lora_adapter = "";  // lora adapter path
     std::string lora_base    = "";  // base model path for the lora adapter
 
-    bool memory_f16        = true;  // use f16 instead of f32 for memory kv
+    std::string cache_type_k = "f16"; // KV cache data type for K: f32, f16, q8_0 or q4_0
+    std::string cache_type_v = "f16"; // KV cache data type for V: f32, f16, q8_0 or q4_0
+
     bool random_prompt     = false; // do not randomize prompt if none provided
     bool use_color         = false; // use color to distinguish generations and inputs
     bool interactive       = false; // interactive mode
@@ -73,8 +78,13 @@ struct gpt_params {
     bool instruct          = false; // instruction mode (used for Alpaca models)
     bool penalize_nl       = true;  // consider newlines as a repeatable token
     bool perplexity        = false; // compute perplexity over the prompt
+    bool flash_attn        = true;  // use the fused attention op
+    bool v_rows            = true;  // store the V cache row-major like K
+    bool calibrate         = false; // measure the cost model of the thread scheduling on this host
     bool use_mmap          = true;  // use mmap for faster loads
     bool use_mlock         = false; // use mlock to keep model in memory
+    bool repack            = false; // repack the weights for the CPU matrix multiplication
+    bool concat_weights    = false; // concatenate the weights that multiply the same input
     bool mem_test          = false; // compute maximum memory usage
     bool numa              = false; // attempt optimizations that help on some NUMA systems
     bool export_cgraph     = false; // export the computation graph
@@ -87,6 +97,9 @@ void gpt_print_usage(int argc, char ** argv, const gpt_params & params);
 
 std::string gpt_random_prompt(std::mt19937 & rng);
 
+// KV cache type from its name (f32, f16, q8_0, q4_0), GGML_TYPE_COUNT if unknown
+ggml_type kv_cache_type_from_str(const std::string & s);
+
 //
 // Vocab utils
 //
@@ -365,16 +365,19 @@ int main(int argc, char ** argv) {
 
             // infinite text generation via context swapping
             // if we run out of context:
-            // - take the n_keep first tokens from the original prompt (via n_past)
-            // - take half of the last (n_ctx - n_keep) tokens and recompute the logits in batches
+            // - keep the n_keep first tokens from the original prompt
+            // - drop the first half of the last (n_ctx - n_keep) tokens from the KV cache
+            //   and shift the second half down, without recomputing it
             if (n_past + (int) embd.size() > n_ctx) {
-                const int n_left = n_past - params.n_keep;
-
                 // always keep the first token - BOS
-                n_past = std::max(1, params.n_keep);
+                const int n_keep    = std::max(1, params.n_keep);
+                const int n_left    = n_past - n_keep;
+                const int n_discard = n_left/2;
+
+                llama_kv_cache_seq_rm   (ctx, 0, n_keep, n_keep + n_discard);
+                llama_kv_cache_seq_shift(ctx, 0, n_keep + n_discard, n_past, -n_discard);
 
-                // insert n_left/2 tokens at the start of embd from last_n_tokens
-                embd.insert(embd.begin(), last_n_tokens.begin() + n_ctx - n_left/2 - embd.size(), last_n_tokens.end() - embd.size());
+                n_past -= n_discard;
 
                 // stop saving session if we run out of context
                 path_session.clear();
@@ -38,6 +38,11 @@ void perplexity(llama_context * ctx, const gpt_params & params) {
     const int n_vocab = llama_n_vocab(ctx);
     const int n_batch = params.n_batch;
 
+    // perplexity is computed over the last half of each chunk, only those logits are needed
+    const int first = std::min(512, params.n_ctx / 2);
+
+    llama_batch batch = llama_batch_init(n_batch);
+
     double nll = 0.0;
     fprintf(stderr, "%s: calculating perplexity over %d chunks, batch_size=%d\n", __func__, n_chunk, n_batch);
 
@@ -51,6 +56,8 @@ void perplexity(llama_context * ctx, const gpt_params & params) {
 
         const auto t_start = std::chrono::high_resolution_clock::now();
 
+        llama_kv_cache_seq_rm(ctx, 0, -1, -1);
+
         for (int j = 0; j < num_batches; ++j) {
             const int batch_start = start + j * n_batch;
             const int batch_size  = std::min(end - batch_start, n_batch);
@@ -63,16 +70,31 @@ void perplexity(llama_context * ctx, const gpt_params & params) {
                 tokens[batch_start] = llama_token_bos();
             }
 
-            if (llama_eval(ctx, tokens.data() + batch_start, batch_size, j * n_batch, params.n_threads)) {
+            batch.n_tokens = batch_size;
+            for (int k = 0; k < batch_size; ++k) {
+                const int pos = j*n_batch + k;
+
+                batch.token [k] = tokens[batch_start + k];
+                batch.pos   [k] = pos;
+                batch.seq_id[k] = 0;
+                batch.logits[k] = pos >= first && pos < params.n_ctx - 1;
+            }
+
+            if (llama_eval_batch(ctx, batch, params.n_threads)) {
                 fprintf(stderr, "%s : failed to eval\n", __func__);
+                llama_batch_free(batch);
                 return;
             }
 
             // restore the original token in case it was set to BOS
             tokens[batch_start] = token_org;
 
-            const auto batch_logits = llama_get_logits(ctx);
-            logits.insert(logits.end(), batch_logits, batch_logits + batch_size * n_vocab);
+            for (int k = 0; k < batch_size; ++k) {
+                const float * tok_logits = llama_get_logits_ith(ctx, k);
+                if (tok_logits) {
+                    logits.insert(logits.end(), tok_logits, tok_logits + n_vocab);
+                }
+            }
         }
 
         const auto t_end = std::chrono::high_resolution_clock::now();
@@ -88,9 +110,9 @@ void perplexity(llama_context * ctx, const gpt_params & params) {
             fprintf(stderr, "%d minutes\n", total_seconds / 60);
         }
 
-        // We get the logits for all the tokens in the context window (params.n_ctx)
-        // from llama_eval above.  Now, based on https://huggingface.co/docs/transformers/perplexity,
-        // calculate the perplexity over the last half of the window (so the model always has
+        // We get the logits for the tokens in the last half of the context window (params.n_ctx)
+        // from llama_eval_batch above.  Based on https://huggingface.co/docs/transformers/perplexity,
+        // the perplexity is calculated over the last half of the window (so the model always has
         // some context to predict the token).
         //
         // We rely on the fact that attention in the forward pass only looks at previous
@@ -100,11 +122,11 @@ void perplexity(llama_context * ctx, const gpt_params & params) {
         // Example, we have a context window of 512, we will compute perplexity for each of the
         // last 256 tokens.  Then, we split the input up into context window size chunks to
         // process the entire prompt.
-        for (int j = std::min(512, params.n_ctx / 2); j < params.n_ctx - 1; ++j) {
+        for (int j = first; j < params.n_ctx - 1; ++j) {
             // Calculate probability of next token, given the previous ones.
             const std::vector<float> tok_logits(
-                logits.begin() + (j + 0) * n_vocab,
-                logits.begin() + (j + 1) * n_vocab);
+                logits.begin() + (j - first + 0) * n_vocab,
+                logits.begin() + (j - first + 1) * n_vocab);
 
             const float prob = softmax(tok_logits)[tokens[start + j + 1]];
 
@@ -116,6 +138,8 @@ void perplexity(llama_context * ctx, const gpt_params & params) {
         fflush(stdout);
     }
     printf("\n");
+
+    llama_batch_free(batch);
 }
 
 int main(int argc, char ** argv) {
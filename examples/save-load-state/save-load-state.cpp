@@ -27,7 +27,8 @@ int main(int argc, char ** argv) {
 
     lparams.n_ctx     = params.n_ctx;
     lparams.seed      = params.seed;
-    lparams.f16_kv    = params.memory_f16;
+    lparams.type_k    = kv_cache_type_from_str(params.cache_type_k);
+    lparams.type_v    = kv_cache_type_from_str(params.cache_type_v);
     lparams.use_mmap  = params.use_mmap;
     lparams.use_mlock = params.use_mlock;
 
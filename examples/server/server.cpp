@@ -225,13 +225,18 @@ struct llama_server_context {
         llama_token result = -1;
 
         if (embd.size() >= (size_t)params.n_ctx) {
-            // Reset context
-            const int n_left = (params.n_ctx - params.n_keep) / 2;
+            // Shift context: drop the tokens between n_keep and the last n_left ones
+            // the KV cache entries of the kept tail are shifted down instead of being recomputed
+            const int n_left    = (params.n_ctx - params.n_keep) / 2;
+            const int n_discard = (int)embd.size() - params.n_keep - n_left;
+
+            llama_kv_cache_seq_rm   (ctx, 0, params.n_keep, params.n_keep + n_discard);
+            llama_kv_cache_seq_shift(ctx, 0, params.n_keep + n_discard, n_past, -n_discard);
 
             std::vector<llama_token> new_tokens(embd.begin(), embd.begin() + params.n_keep);
             new_tokens.insert(new_tokens.end(), embd.end() - n_left, embd.end());
             embd = new_tokens;
-            n_past = params.n_keep;
+            n_past -= n_discard;
             truncated = true;
             LOG_VERBOSE("input truncated", {
                 { "n_ctx", params.n_ctx },
@@ -462,6 +467,8 @@ static void server_print_usage(const char * argv0, const gpt_params & params,
     if (llama_mmap_supported()) {
         fprintf(stderr, "  --no-mmap             do not memory-map model (slower load but may reduce pageouts if not using mlock)\n");
     }
+    fprintf(stderr, "  --repack              repack the weights for the CPU matrix multiplication, cached in MODEL.repack\n");
+    fprintf(stderr, "  --concat-weights      concatenate the Q, K, V and the gate, up weights to multiply each group at once\n");
 #ifdef LLAMA_SUPPORTS_GPU_OFFLOAD
     fprintf(stderr, "  -ngl N, --n-gpu-layers N\n");
     fprintf(stderr, "                        number of layers to store in VRAM\n");
@@ -534,7 +541,8 @@ static void server_params_parse(int argc, char ** argv, server_params & sparams,
             }
             params.n_ctx = std::stoi(argv[i]);
         } else if (arg == "--memory-f32" || arg == "--memory_f32") {
-            params.memory_f16 = false;
+            params.cache_type_k = "f32";
+            params.cache_type_v = "f32";
         } else if (arg == "--threads" || arg == "-t") {
             if (++i >= argc) {
                 invalid_param = true;
@@ -627,6 +635,10 @@ static void server_params_parse(int argc, char ** argv, server_params & sparams,
             params.use_mlock = true;
         } else if (arg == "--no-mmap") {
             params.use_mmap = false;
+        } else if (arg == "--repack") {
+            params.repack = true;
+        } else if (arg == "--concat-weights") {
+            params.concat_weights = true;
         } else if (arg == "--embedding") {
             params.embedding = true;
         } else {
@@ -0,0 +1,297 @@
+#include "build-info.h"
+
+#include "common.h"
+#include "llama.h"
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// sample the next token from the target model logits with the usual sampling parameters
+// (greedy if temp <= 0) - a draft token is accepted only if it is the token the target samples at its position,
+// so the output follows the same distribution as sampling from the target model alone
+static llama_token sample_token(llama_context * ctx, const float * logits, const gpt_params & params) {
+    const int n_vocab = llama_n_vocab(ctx);
+
+    std::vector<llama_token_data> candidates;
+    candidates.reserve(n_vocab);
+    for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+        candidates.emplace_back(llama_token_data{token_id, logits[token_id], 0.0f});
+    }
+
+    llama_token_data_array candidates_p = { candidates.data(), candidates.size(), false };
+
+    if (params.temp <= 0) {
+        return llama_sample_token_greedy(ctx, &candidates_p);
+    }
+
+    const int top_k = params.top_k <= 0 ? n_vocab : params.top_k;
+
+    llama_sample_top_k      (ctx, &candidates_p, top_k, 1);
+    llama_sample_tail_free  (ctx, &candidates_p, params.tfs_z, 1);
+    llama_sample_typical    (ctx, &candidates_p, params.typical_p, 1);
+    llama_sample_top_p      (ctx, &candidates_p, params.top_p, 1);
+    llama_sample_temperature(ctx, &candidates_p, params.temp);
+
+    return llama_sample_token(ctx, &candidates_p);
+}
+
+// evaluate tokens [n_past, inp.size()) of sequence 0 in chunks of n_batch
+static bool eval_tokens(llama_context * ctx, const std::vector<llama_token> & inp, int n_past, const gpt_params & params) {
+    for (int i = n_past; i < (int) inp.size(); i += params.n_batch) {
+        const int n_eval = std::min((int) inp.size() - i, params.n_batch);
+        if (llama_eval(ctx, inp.data() + i, n_eval, i, params.n_threads)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// generate with the target model, drafting n_draft tokens ahead with the draft model
+// batch holds the last sampled token and the drafted tokens that the target model verifies
+static bool speculative_decode(llama_context * ctx_tgt, llama_context * ctx_dft, llama_batch & batch, const gpt_params & params) {
+    // tokenize the prompt
+    std::vector<llama_token> inp = ::llama_tokenize(ctx_tgt, params.prompt, true);
+
+    const int n_ctx   = llama_n_ctx(ctx_tgt);
+    const int n_draft = params.n_draft;
+
+    if ((int) inp.size() + n_draft + 1 > n_ctx) {
+        fprintf(stderr, "%s: error: prompt too long (%d tokens, max %d)\n", __func__, (int) inp.size(), n_ctx - n_draft - 1);
+        return false;
+    }
+
+    fprintf(stderr, "\n\n");
+
+    for (auto id : inp) {
+        printf("%s", llama_token_to_str(ctx_tgt, id));
+    }
+    fflush(stdout);
+
+    const int64_t t_enc_start = llama_time_us();
+
+    // evaluate the prompt with both models
+    if (!eval_tokens(ctx_tgt, inp, 0, params) || !eval_tokens(ctx_dft, inp, 0, params)) {
+        fprintf(stderr, "%s : failed to eval\n", __func__);
+        return false;
+    }
+
+    const int64_t t_enc_end = llama_time_us();
+
+    // inp holds the tokens in the target KV cache followed by the last sampled token, which is not evaluated yet
+    llama_token id = sample_token(ctx_tgt, llama_get_logits(ctx_tgt), params);
+    inp.push_back(id);
+
+    // number of leading tokens of inp in the KV cache of the draft model
+    int n_past_dft = inp.size() - 1;
+
+    int n_predict = 1;
+    int n_drafted = 0;
+    int n_accept  = 0;
+
+    std::vector<llama_token> drafted;
+
+    const int64_t t_dec_start = llama_time_us();
+
+    while (true) {
+        if (id == llama_token_eos()) {
+            fprintf(stderr, " [end of text]\n");
+            break;
+        }
+
+        printf("%s", llama_token_to_str(ctx_tgt, id));
+        fflush(stdout);
+
+        if (params.n_predict > 0 && n_predict >= params.n_predict) {
+            break;
+        }
+
+        const int64_t t_step_start = llama_time_us();
+
+        // the target cache holds inp[0, n_past), inp[n_past] is the last sampled token
+        const int n_past = inp.size() - 1;
+
+        // draft up to n_draft tokens greedily, first catching the draft model up with the tokens it has not seen
+        drafted.clear();
+        {
+            if (!eval_tokens(ctx_dft, inp, n_past_dft, params)) {
+                fprintf(stderr, "%s : failed to eval\n", __func__);
+                return false;
+            }
+            n_past_dft = inp.size();
+
+            for (int i = 0; i < n_draft; ++i) {
+                const float * logits = llama_get_logits(ctx_dft);
+
+                llama_token best = 0;
+                for (llama_token token_id = 1; token_id < llama_n_vocab(ctx_dft); ++token_id) {
+                    if (logits[token_id] > logits[best]) {
+                        best = token_id;
+                    }
+                }
+
+                drafted.push_back(best);
+                if (best == llama_token_eos() || i == n_draft - 1) {
+                    break;
+                }
+
+                if (llama_eval(ctx_dft, &best, 1, n_past_dft, params.n_threads)) {
+                    fprintf(stderr, "%s : failed to eval\n", __func__);
+                    return false;
+                }
+                n_past_dft++;
+            }
+        }
+
+        // verify the last sampled token and the drafted tokens with the target model in one batch
+        batch.n_tokens = 1 + drafted.size();
+        for (int i = 0; i < batch.n_tokens; ++i) {
+            batch.token [i] = i == 0 ? id : drafted[i - 1];
+            batch.pos   [i] = n_past + i;
+            batch.seq_id[i] = 0;
+            batch.logits[i] = true;
+        }
+
+        if (llama_eval_batch(ctx_tgt, batch, params.n_threads)) {
+            fprintf(stderr, "%s : failed to eval\n", __func__);
+            return false;
+        }
+
+        // keep the longest prefix of drafted tokens that the target model samples itself,
+        // the target token that follows it is always kept
+        int n_step_accept = 0;
+        while (true) {
+            id = sample_token(ctx_tgt, llama_get_logits_ith(ctx_tgt, n_step_accept), params);
+            n_predict++;
+
+            if (n_step_accept < (int) drafted.size() && id == drafted[n_step_accept] &&
+                id != llama_token_eos() && (params.n_predict <= 0 || n_predict < params.n_predict)) {
+                printf("%s", llama_token_to_str(ctx_tgt, id));
+                inp.push_back(id);
+                n_step_accept++;
+                continue;
+            }
+
+            inp.push_back(id);
+            break;
+        }
+
+        // roll back the rejected tokens from both caches
+        llama_kv_cache_seq_rm(ctx_tgt, 0, inp.size() - 1, -1);
+        if (n_past_dft > (int) inp.size() - 1) {
+            llama_kv_cache_seq_rm(ctx_dft, 0, inp.size() - 1, -1);
+            n_past_dft = inp.size() - 1;
+        }
+
+        n_drafted += drafted.size();
+        n_accept  += n_step_accept;
+
+        llama_draft_record(ctx_tgt, drafted.size(), n_step_accept, llama_time_us() - t_step_start);
+
+        if ((int) inp.size() + n_draft + 1 > n_ctx) {
+            printf("%s", llama_token_to_str(ctx_tgt, id));
+            fprintf(stderr, "\n\n%s: context full, stopping\n", __func__);
+            break;
+        }
+    }
+
+    const int64_t t_dec_end = llama_time_us();
+
+    fprintf(stderr, "\n\n");
+
+    fprintf(stderr, "encoded %4d tokens in %8.3f seconds, speed: %8.3f t/s\n", (int) inp.size() - n_predict, (t_enc_end - t_enc_start) / 1e6f, (inp.size() - n_predict) / ((t_enc_end - t_enc_start) / 1e6f));
+    fprintf(stderr, "decoded %4d tokens in %8.3f seconds, speed: %8.3f t/s\n", n_predict, (t_dec_end - t_dec_start) / 1e6f, n_predict / ((t_dec_end - t_dec_start) / 1e6f));
+
+    fprintf(stderr, "\n");
+    fprintf(stderr, "n_draft   = %d\n", n_draft);
+    fprintf(stderr, "n_predict = %d\n", n_predict);
+    fprintf(stderr, "n_drafted = %d\n", n_drafted);
+    fprintf(stderr, "n_accept  = %d\n", n_accept);
+    fprintf(stderr, "accept    = %.3f%%\n", 100.0f * n_accept / std::max(1, n_drafted));
+
+    fprintf(stderr, "\ndraft:\n");
+    llama_print_timings(ctx_dft);
+
+    fprintf(stderr, "\ntarget:\n");
+    llama_print_timings(ctx_tgt);
+
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    gpt_params params;
+
+    if (gpt_params_parse(argc, argv, params) == false) {
+        return 1;
+    }
+
+    if (params.model_draft.empty()) {
+        fprintf(stderr, "%s: error: --model-draft is required\n", __func__);
+        return 1;
+    }
+
+    if (params.n_draft < 1) {
+        fprintf(stderr, "%s: error: --draft must be at least 1\n", __func__);
+        return 1;
+    }
+
+    if (params.seed < 0) {
+        params.seed = time(NULL);
+    }
+
+    fprintf(stderr, "%s: build = %d (%s)\n", __func__, BUILD_NUMBER, BUILD_COMMIT);
+    fprintf(stderr, "%s: seed  = %d\n", __func__, params.seed);
+
+    llama_init_backend(params.numa);
+
+    llama_model * model_tgt = NULL;
+    llama_model * model_dft = NULL;
+
+    llama_context * ctx_tgt = NULL;
+    llama_context * ctx_dft = NULL;
+
+    // load the target model
+    std::tie(model_tgt, ctx_tgt) = llama_init_from_gpt_params(params);
+    if (model_tgt == NULL) {
+        return 1;
+    }
+
+    // load the draft model
+    {
+        gpt_params params_dft = params;
+        params_dft.model = params.model_draft;
+        params_dft.lora_adapter.clear();
+
+        std::tie(model_dft, ctx_dft) = llama_init_from_gpt_params(params_dft);
+        if (model_dft == NULL) {
+            llama_free(ctx_tgt);
+            llama_free_model(model_tgt);
+            return 1;
+        }
+    }
+
+    llama_batch batch = llama_batch_init(params.n_draft + 1);
+
+    // the errors past this point go through the cleanup below
+    bool ok = false;
+
+    if (llama_n_vocab(ctx_tgt) != llama_n_vocab(ctx_dft)) {
+        fprintf(stderr, "%s: error: the draft model has a different vocabulary (%d tokens) than the target model (%d tokens)\n",
+                __func__, llama_n_vocab(ctx_dft), llama_n_vocab(ctx_tgt));
+    } else {
+        ok = speculative_decode(ctx_tgt, ctx_dft, batch, params);
+    }
+
+    llama_batch_free(batch);
+
+    llama_free(ctx_tgt);
+    llama_free_model(model_tgt);
+
+    llama_free(ctx_dft);
+    llama_free_model(model_dft);
+
+    fprintf(stderr, "\n\n");
+
+    return ok ? 0 : 1;
+}
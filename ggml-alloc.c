@@ -0,0 +1,369 @@
+#include "ggml-alloc.h"
+#include "ggml.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// max number of free blocks of the buffer, the blocks are merged when released so few are needed in practice
+#define GGML_ALLOCR_MAX_FREE_BLOCKS 256
+
+// size of the hash table of the tensors of a graph - a prime larger than the number of nodes and leafs
+#define GGML_ALLOCR_HASH_SIZE 8273
+
+// address of the buffer of a measure allocator, no memory is accessed there
+#define GGML_ALLOCR_MEASURE_BASE 0x1000
+
+struct free_block {
+    char * addr;
+    size_t size;
+};
+
+struct hash_node {
+    struct ggml_tensor * t;
+
+    int  n_children; // nodes of the graph that use the tensor and are not computed yet
+    int  n_views;    // views of the tensor (it is their root) that are still used
+    bool owned;      // the data was allocated by the graph allocator and is released with the tensor
+};
+
+struct ggml_allocr {
+    char * data;
+    size_t size;
+    size_t alignment;
+    size_t max_size;
+    bool   measure;
+
+    int n_free_blocks;
+    struct free_block free_blocks[GGML_ALLOCR_MAX_FREE_BLOCKS];
+
+    struct hash_node hash_table[GGML_ALLOCR_HASH_SIZE];
+};
+
+static struct hash_node * ggml_allocr_hash_get(struct ggml_allocr * alloc, struct ggml_tensor * t) {
+    const size_t h = (size_t)(uintptr_t) t % GGML_ALLOCR_HASH_SIZE;
+
+    size_t i = h;
+    while (alloc->hash_table[i].t != NULL && alloc->hash_table[i].t != t) {
+        i = (i + 1) % GGML_ALLOCR_HASH_SIZE;
+        GGML_ASSERT(i != h); // the hash table is full
+    }
+
+    alloc->hash_table[i].t = t;
+
+    return &alloc->hash_table[i];
+}
+
+static size_t ggml_allocr_aligned_size(const struct ggml_allocr * alloc, const struct ggml_tensor * tensor) {
+    return (ggml_nbytes(tensor) + alloc->alignment - 1)/alloc->alignment*alloc->alignment;
+}
+
+static bool ggml_allocr_is_view(const struct ggml_tensor * t) {
+    return t->op == GGML_OP_VIEW || t->op == GGML_OP_RESHAPE || t->op == GGML_OP_PERMUTE || t->op == GGML_OP_TRANSPOSE ||
+           t->op == GGML_OP_CPY;
+}
+
+// the tensor whose memory a view uses, the result of ggml_cpy is a view of its destination
+static struct ggml_tensor * ggml_allocr_view_parent(const struct ggml_tensor * t) {
+    return t->op == GGML_OP_CPY ? t->src1 : t->src0;
+}
+
+static struct ggml_tensor * ggml_allocr_view_root(struct ggml_tensor * t) {
+    while (ggml_allocr_is_view(t)) {
+        t = ggml_allocr_view_parent(t);
+    }
+    return t;
+}
+
+// ops whose result can be computed in the memory of a source with the same layout
+static bool ggml_allocr_op_can_inplace(enum ggml_op op) {
+    switch (op) {
+        case GGML_OP_ADD:
+        case GGML_OP_ADD1:
+        case GGML_OP_SUB:
+        case GGML_OP_MUL:
+        case GGML_OP_DIV:
+        case GGML_OP_SQR:
+        case GGML_OP_SQRT:
+        case GGML_OP_LOG:
+        case GGML_OP_ABS:
+        case GGML_OP_SGN:
+        case GGML_OP_NEG:
+        case GGML_OP_STEP:
+        case GGML_OP_RELU:
+        case GGML_OP_GELU:
+        case GGML_OP_GELU_QUICK:
+        case GGML_OP_SILU:
+        case GGML_OP_NORM:
+        case GGML_OP_RMS_NORM:
+        case GGML_OP_RMS_NORM_MUL:
+        case GGML_OP_SCALE:
+        case GGML_OP_SOFT_MAX:
+        case GGML_OP_ROPE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool ggml_allocr_same_layout(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    return a->type == b->type && ggml_nbytes(a) == ggml_nbytes(b) && ggml_is_contiguous(a) && ggml_is_contiguous(b);
+}
+
+struct ggml_allocr * ggml_allocr_new(void * data, size_t size, size_t alignment) {
+    GGML_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    struct ggml_allocr * alloc = (struct ggml_allocr *) malloc(sizeof(struct ggml_allocr));
+
+    alloc->data      = (char *) data;
+    alloc->size      = size;
+    alloc->alignment = alignment;
+    alloc->measure   = false;
+
+    ggml_allocr_reset(alloc);
+
+    return alloc;
+}
+
+struct ggml_allocr * ggml_allocr_new_measure(size_t alignment) {
+    struct ggml_allocr * alloc = ggml_allocr_new((void *) GGML_ALLOCR_MEASURE_BASE, SIZE_MAX/2, alignment);
+
+    alloc->measure = true;
+
+    return alloc;
+}
+
+void ggml_allocr_free(struct ggml_allocr * alloc) {
+    free(alloc);
+}
+
+bool ggml_allocr_is_measure(struct ggml_allocr * alloc) {
+    return alloc->measure;
+}
+
+void ggml_allocr_reset(struct ggml_allocr * alloc) {
+    // the start of the buffer is aligned, so that the offsets of the tensors are aligned too
+    const size_t pad = (alloc->alignment - (uintptr_t) alloc->data % alloc->alignment) % alloc->alignment;
+
+    GGML_ASSERT(pad <= alloc->size);
+
+    alloc->n_free_blocks = 1;
+    alloc->free_blocks[0].addr = alloc->data + pad;
+    alloc->free_blocks[0].size = alloc->size - pad;
+
+    alloc->max_size = pad;
+}
+
+void ggml_allocr_alloc(struct ggml_allocr * alloc, struct ggml_tensor * tensor) {
+    GGML_ASSERT(tensor->data == NULL);
+
+    const size_t size = ggml_allocr_aligned_size(alloc, tensor);
+
+    // best fit among the free blocks - the last block, at the end of the used part of the buffer, is used only
+    // when no other block fits, so that the used part grows as little as possible
+    int best = -1;
+    for (int i = 0; i < alloc->n_free_blocks - 1; ++i) {
+        const struct free_block * block = &alloc->free_blocks[i];
+        if (block->size >= size && (best == -1 || block->size < alloc->free_blocks[best].size)) {
+            best = i;
+        }
+    }
+
+    if (best == -1) {
+        best = alloc->n_free_blocks - 1;
+
+        if (best < 0 || alloc->free_blocks[best].size < size) {
+            fprintf(stderr, "%s: not enough space in the buffer for %s (needed %zu, largest block available %zu)\n",
+                    __func__, tensor->name, size, best < 0 ? 0 : alloc->free_blocks[best].size);
+            GGML_ASSERT(false);
+        }
+    }
+
+    struct free_block * block = &alloc->free_blocks[best];
+
+    tensor->data = block->addr;
+
+    block->addr += size;
+    block->size -= size;
+
+    if (block->size == 0) {
+        alloc->n_free_blocks--;
+        for (int i = best; i < alloc->n_free_blocks; ++i) {
+            alloc->free_blocks[i] = alloc->free_blocks[i + 1];
+        }
+    }
+
+    alloc->max_size = MAX(alloc->max_size, (size_t) ((char *) tensor->data - alloc->data) + size);
+}
+
+// return the memory of the tensor to the free blocks, which are kept sorted by address and merged
+static void ggml_allocr_release(struct ggml_allocr * alloc, struct ggml_tensor * tensor) {
+    char * addr = (char *) tensor->data;
+    const size_t size = ggml_allocr_aligned_size(alloc, tensor);
+
+    GGML_ASSERT(addr >= alloc->data && addr + size <= alloc->data + alloc->size);
+
+    int i = 0;
+    while (i < alloc->n_free_blocks && alloc->free_blocks[i].addr < addr) {
+        i++;
+    }
+
+    const bool merge_prev = i > 0 && alloc->free_blocks[i - 1].addr + alloc->free_blocks[i - 1].size == addr;
+    const bool merge_next = i < alloc->n_free_blocks && addr + size == alloc->free_blocks[i].addr;
+
+    if (merge_prev && merge_next) {
+        alloc->free_blocks[i - 1].size += size + alloc->free_blocks[i].size;
+        alloc->n_free_blocks--;
+        for (int j = i; j < alloc->n_free_blocks; ++j) {
+            alloc->free_blocks[j] = alloc->free_blocks[j + 1];
+        }
+    } else if (merge_prev) {
+        alloc->free_blocks[i - 1].size += size;
+    } else if (merge_next) {
+        alloc->free_blocks[i].addr  = addr;
+        alloc->free_blocks[i].size += size;
+    } else {
+        GGML_ASSERT(alloc->n_free_blocks < GGML_ALLOCR_MAX_FREE_BLOCKS);
+        for (int j = alloc->n_free_blocks; j > i; --j) {
+            alloc->free_blocks[j] = alloc->free_blocks[j - 1];
+        }
+        alloc->free_blocks[i].addr = addr;
+        alloc->free_blocks[i].size = size;
+        alloc->n_free_blocks++;
+    }
+}
+
+static void ggml_allocr_alloc_node(struct ggml_allocr * alloc, struct ggml_tensor * node) {
+    if (node->data != NULL) {
+        return;
+    }
+
+    if (ggml_allocr_is_view(node)) {
+        struct ggml_tensor * parent = ggml_allocr_view_parent(node);
+
+        ggml_allocr_alloc_node(alloc, parent);
+
+        size_t offset = 0;
+        if (node->op == GGML_OP_VIEW) {
+            memcpy(&offset, node->opt[0]->data, sizeof(offset));
+        }
+
+        node->data = (char *) parent->data + offset;
+        return;
+    }
+
+    // compute the node in the memory of a source that is not used after it
+    if (ggml_allocr_op_can_inplace(node->op)) {
+        struct ggml_tensor * srcs[2] = { node->src0, node->src1 };
+
+        for (int i = 0; i < 2; ++i) {
+            struct ggml_tensor * parent = srcs[i];
+            if (parent == NULL || parent->data == NULL || !ggml_allocr_same_layout(node, parent)) {
+                continue;
+            }
+
+            struct ggml_tensor * root = ggml_allocr_view_root(parent);
+
+            struct hash_node * p_hn = ggml_allocr_hash_get(alloc, parent);
+            struct hash_node * r_hn = ggml_allocr_hash_get(alloc, root);
+
+            if (!r_hn->owned || p_hn->n_children != 1 || root->data != parent->data || !ggml_allocr_same_layout(node, root)) {
+                continue;
+            }
+
+            // the root is still used by the parent only
+            if (parent != root && (r_hn->n_children != 0 || r_hn->n_views != 1)) {
+                continue;
+            }
+            if (parent == root && p_hn->n_views != 0) {
+                continue;
+            }
+
+            node->data = parent->data;
+
+            r_hn->owned = false;
+            ggml_allocr_hash_get(alloc, node)->owned = true;
+            return;
+        }
+    }
+
+    ggml_allocr_alloc(alloc, node);
+    ggml_allocr_hash_get(alloc, node)->owned = true;
+}
+
+// a tensor that is not used anymore releases its memory, or its use of the memory of the tensor it views
+static void ggml_allocr_release_unused(struct ggml_allocr * alloc, struct ggml_tensor * tensor) {
+    struct hash_node * hn = ggml_allocr_hash_get(alloc, tensor);
+
+    if (hn->n_children > 0 || hn->n_views > 0) {
+        return;
+    }
+
+    if (ggml_allocr_is_view(tensor)) {
+        struct ggml_tensor * root = ggml_allocr_view_root(tensor);
+        struct hash_node * r_hn = ggml_allocr_hash_get(alloc, root);
+
+        r_hn->n_views--;
+        ggml_allocr_release_unused(alloc, root);
+        return;
+    }
+
+    if (hn->owned) {
+        ggml_allocr_release(alloc, tensor);
+        hn->owned = false;
+    }
+}
+
+size_t ggml_allocr_alloc_graph(struct ggml_allocr * alloc, struct ggml_cgraph * graph) {
+    memset(alloc->hash_table, 0, sizeof(alloc->hash_table));
+
+    // count the users of each tensor
+    for (int i = 0; i < graph->n_nodes; ++i) {
+        struct ggml_tensor * node = graph->nodes[i];
+
+        if (ggml_allocr_is_view(node)) {
+            ggml_allocr_hash_get(alloc, ggml_allocr_view_root(node))->n_views++;
+        }
+
+        struct ggml_tensor * srcs[2 + GGML_MAX_OPT] = { node->src0, node->src1 };
+        memcpy(srcs + 2, node->opt, sizeof(node->opt));
+
+        for (int j = 0; j < 2 + GGML_MAX_OPT; ++j) {
+            if (srcs[j] != NULL) {
+                ggml_allocr_hash_get(alloc, srcs[j])->n_children++;
+            }
+        }
+    }
+
+    // allocate the nodes in the order they are computed, and release the sources after their last user
+    for (int i = 0; i < graph->n_nodes; ++i) {
+        struct ggml_tensor * node = graph->nodes[i];
+
+        struct ggml_tensor * srcs[2 + GGML_MAX_OPT] = { node->src0, node->src1 };
+        memcpy(srcs + 2, node->opt, sizeof(node->opt));
+
+        // leafs without data, e.g. the destination of a ggml_cpy
+        for (int j = 0; j < 2 + GGML_MAX_OPT; ++j) {
+            if (srcs[j] != NULL) {
+                ggml_allocr_alloc_node(alloc, srcs[j]);
+            }
+        }
+
+        ggml_allocr_alloc_node(alloc, node);
+
+        for (int j = 0; j < 2 + GGML_MAX_OPT; ++j) {
+            if (srcs[j] == NULL) {
+                continue;
+            }
+
+            ggml_allocr_hash_get(alloc, srcs[j])->n_children--;
+            ggml_allocr_release_unused(alloc, srcs[j]);
+        }
+    }
+
+    return alloc->max_size;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ggml.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+//
+// graph allocator
+//
+// assigns the data of the tensors of a graph built in a no_alloc context to offsets in a single buffer,
+// reusing the memory of the intermediate results that are no longer needed by the rest of the graph:
+//
+//   - views (VIEW, RESHAPE, PERMUTE, TRANSPOSE and the result of CPY) share the memory of the tensor they view
+//   - element-wise ops reuse the memory of their source when they are its last user
+//   - the memory of a tensor is released after the last node that uses it or any of its views
+//   - the nodes without users in the graph (the results) and the tensors that already have data are never released
+//
+// typical use: plan a worst-case graph with a measure allocator to size the buffer once, then allocate each
+// graph with an allocator on that buffer - the tensors are valid until the allocator is reset
+//
+//   struct ggml_allocr * alloc = ggml_allocr_new_measure(alignment);
+//   size_t size = ggml_allocr_alloc_graph(alloc, &gf_worst) + alignment;
+//   ggml_allocr_free(alloc);
+//
+//   alloc = ggml_allocr_new(malloc(size), size, alignment);
+//   ...
+//   ggml_allocr_reset(alloc);
+//   ggml_allocr_alloc_graph(alloc, &gf);
+//
+
+struct ggml_allocr;
+
+GGML_API struct ggml_allocr * ggml_allocr_new(void * data, size_t size, size_t alignment);
+
+// an allocator that only measures the size of the buffer a graph needs, the data of its tensors cannot be accessed
+GGML_API struct ggml_allocr * ggml_allocr_new_measure(size_t alignment);
+
+GGML_API void ggml_allocr_free      (struct ggml_allocr * alloc);
+GGML_API bool ggml_allocr_is_measure(struct ggml_allocr * alloc);
+
+// release all the allocations
+GGML_API void ggml_allocr_reset(struct ggml_allocr * alloc);
+
+// allocate a single tensor, e.g. an input of a graph that is set before the graph is allocated
+// tensors allocated this way are not released by ggml_allocr_alloc_graph()
+GGML_API void ggml_allocr_alloc(struct ggml_allocr * alloc, struct ggml_tensor * tensor);
+
+// allocate the tensors of the graph without data, returns the size of the buffer used so far
+GGML_API size_t ggml_allocr_alloc_graph(struct ggml_allocr * alloc, struct ggml_cgraph * graph);
+
+#ifdef  __cplusplus
+}
+#endif
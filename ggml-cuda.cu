@@ -2177,8 +2177,12 @@ inline void ggml_cuda_op_rope(
     const int mode   = ((int32_t *) src1->data)[2];
     GGML_ASSERT(mode == 0);
 
+    // explicit position of each matrix (ggml_rope_pos), read on the host like the parameters in src1
+    const ggml_tensor * pos = dst->opt[0];
+    GGML_ASSERT(pos == nullptr || pos->backend == GGML_BACKEND_CPU);
+
     const float theta_scale = powf(10000.0, -2.0f/n_dims);
-    const float p = ((mode & 1) == 0 ? n_past + i02 : i02);
+    const float p = pos != nullptr ? ((int32_t *) pos->data)[i02] : ((mode & 1) == 0 ? n_past + i02 : i02);
 
     // compute
     rope_f32_cuda(src0_ddf_i, dst_ddf_i, ne00, i01_diff, p, theta_scale, cudaStream_main);
@@ -2456,7 +2460,7 @@ static void ggml_cuda_op(const ggml_tensor * src0, const ggml_tensor * src1, ggm
                     if (src1->backend == GGML_BACKEND_CPU) {
                         GGML_ASSERT(!flatten_rows || nrows0 == ggml_nrows(src1));
                         int64_t nrows1 = flatten_rows ? nrows0 : ne11;
-                        CUDA_CHECK(ggml_cuda_cpy_tensor_2d(src1_ddf_i, src1, i03, i02, 0, nrows1, cudaStream_main));
+                        CUDA_CHECK(ggml_cuda_cpy_tensor_2d(src1_ddf_i, src1, i13, i12, 0, nrows1, cudaStream_main));
                     } else if (src1->backend == GGML_BACKEND_GPU && src1_is_contiguous) {
                         if (id != g_main_device) {
                             GGML_ASSERT(!flatten_rows);
@@ -2467,7 +2471,7 @@ static void ggml_cuda_op(const ggml_tensor * src0, const ggml_tensor * src1, ggm
                         }
                     } else if (src1_on_device && !src1_is_contiguous) {
                         GGML_ASSERT(!split);
-                        CUDA_CHECK(ggml_cuda_cpy_tensor_2d(src1_ddf_i, src1, i03, i02, 0, ne11, cudaStream_main));
+                        CUDA_CHECK(ggml_cuda_cpy_tensor_2d(src1_ddf_i, src1, i13, i12, 0, ne11, cudaStream_main));
                     } else {
                         GGML_ASSERT(false);
                     }
@@ -2548,7 +2552,10 @@ static void ggml_cuda_op(const ggml_tensor * src0, const ggml_tensor * src1, ggm
 
 void ggml_cuda_add(const ggml_tensor * src0, const ggml_tensor * src1, ggml_tensor * dst) {
     GGML_ASSERT(src0->type == GGML_TYPE_F32 && src1->type == GGML_TYPE_F32 && dst->type == GGML_TYPE_F32);
-    ggml_cuda_op(src0, src1, dst, ggml_cuda_op_add, true, true);
+    // a src1 matrix is added to each matrix of src0 (e.g. KQ_mask to the heads of KQ), the rows are not flattened then
+    const bool broadcast = ggml_nrows(src1) != ggml_nrows(src0);
+    GGML_ASSERT(!broadcast || (src1->ne[0] == src0->ne[0] && src1->ne[1] == src0->ne[1]));
+    ggml_cuda_op(src0, src1, dst, ggml_cuda_op_add, true, !broadcast);
 }
 
 void ggml_cuda_mul(const ggml_tensor * src0, const ggml_tensor * src1, ggml_tensor * dst) {
@@ -2801,7 +2808,7 @@ void ggml_cuda_free_data(struct ggml_tensor * tensor) {
     delete extra;
 }
 
-void ggml_cuda_assign_buffers_impl(struct ggml_tensor * tensor, bool scratch) {
+void ggml_cuda_assign_buffers_impl(struct ggml_tensor * tensor, bool scratch, bool no_alloc) {
     if (scratch && g_scratch_size == 0) {
         return;
     }
@@ -2810,18 +2817,23 @@ void ggml_cuda_assign_buffers_impl(struct ggml_tensor * tensor, bool scratch) {
     if (tensor->src0 != nullptr && tensor->src0->backend == GGML_BACKEND_CPU) {
         const ggml_op src0_op = tensor->src0->op;
         if (src0_op == GGML_OP_RESHAPE || src0_op == GGML_OP_TRANSPOSE || src0_op == GGML_OP_VIEW) {
-            ggml_cuda_assign_buffers_impl(tensor->src0, scratch);
+            ggml_cuda_assign_buffers_impl(tensor->src0, scratch, no_alloc);
         }
     }
     if (tensor->op == GGML_OP_CPY && tensor->src1->backend == GGML_BACKEND_CPU) {
-        ggml_cuda_assign_buffers_impl(tensor->src1, scratch);
+        ggml_cuda_assign_buffers_impl(tensor->src1, scratch, no_alloc);
     }
 
     tensor->backend = GGML_BACKEND_GPU;
+
+    // the VRAM is assigned with ggml_cuda_assign_scratch_offset once the graph allocator has placed the tensor
+    if (scratch && no_alloc) {
+        return;
+    }
     struct ggml_tensor_extra_gpu * extra = new ggml_tensor_extra_gpu;
     memset(extra, 0, sizeof(*extra));
 
-    const bool inplace = (tensor->src0 != nullptr && tensor->src0->data == tensor->data) ||
+    const bool inplace = (tensor->src0 != nullptr && tensor->src0->data == tensor->data && tensor->data != nullptr) ||
         tensor->op == GGML_OP_VIEW;
     const size_t size = ggml_nbytes(tensor);
 
@@ -2865,11 +2877,70 @@ void ggml_cuda_assign_buffers_impl(struct ggml_tensor * tensor, bool scratch) {
 }
 
 void ggml_cuda_assign_buffers(struct ggml_tensor * tensor) {
-    ggml_cuda_assign_buffers_impl(tensor, true);
+    ggml_cuda_assign_buffers_impl(tensor, true, false);
 }
 
 void ggml_cuda_assign_buffers_no_scratch(struct ggml_tensor * tensor) {
-    ggml_cuda_assign_buffers_impl(tensor, false);
+    ggml_cuda_assign_buffers_impl(tensor, false, false);
+}
+
+void ggml_cuda_assign_buffers_no_alloc(struct ggml_tensor * tensor) {
+    ggml_cuda_assign_buffers_impl(tensor, true, true);
+}
+
+void ggml_cuda_assign_scratch_offset(struct ggml_tensor * tensor, size_t offset) {
+    if (g_scratch_size == 0) {
+        return;
+    }
+
+    CUDA_CHECK(cudaSetDevice(g_main_device));
+
+    struct ggml_tensor_extra_gpu * extra = new ggml_tensor_extra_gpu;
+    memset(extra, 0, sizeof(*extra));
+
+    // a view or an inplace result of a tensor with its own VRAM (e.g. the KV cache) uses that VRAM,
+    // the result of ggml_cpy is its destination
+    const ggml_op op = tensor->op;
+    const bool view    = op == GGML_OP_VIEW || op == GGML_OP_RESHAPE || op == GGML_OP_PERMUTE || op == GGML_OP_TRANSPOSE;
+    const bool inplace = tensor->src0 != nullptr && tensor->src0->data == tensor->data && tensor->data != nullptr;
+    struct ggml_tensor * parent = view || inplace ? tensor->src0 : op == GGML_OP_CPY ? tensor->src1 : nullptr;
+
+    if (parent != nullptr && parent->backend == GGML_BACKEND_GPU && parent->extra != nullptr) {
+        struct ggml_tensor_extra_gpu * parent_extra = (ggml_tensor_extra_gpu *) parent->extra;
+        size_t view_offset = 0;
+        if (op == GGML_OP_VIEW) {
+            memcpy(&view_offset, tensor->opt[0]->data, sizeof(size_t));
+        }
+        extra->data_device[g_main_device] = (char *) parent_extra->data_device[g_main_device] + view_offset;
+    } else {
+        // the scratch buffer mirrors the host buffer of the allocator, so the tensors keep their offset in it
+        GGML_ASSERT(offset + ggml_nbytes(tensor) <= g_scratch_size);
+
+        if (g_scratch_buffer == nullptr) {
+            CUDA_CHECK(cudaMalloc(&g_scratch_buffer, g_scratch_size));
+        }
+        extra->data_device[g_main_device] = (char *) g_scratch_buffer + offset;
+    }
+
+    tensor->extra = extra;
+}
+
+void ggml_cuda_copy_to_device(struct ggml_tensor * tensor) {
+    GGML_ASSERT(tensor->backend == GGML_BACKEND_GPU);
+    GGML_ASSERT(ggml_is_contiguous(tensor));
+
+    struct ggml_tensor_extra_gpu * extra = (ggml_tensor_extra_gpu *) tensor->extra;
+    CUDA_CHECK(cudaSetDevice(g_main_device));
+    CUDA_CHECK(cudaMemcpy(extra->data_device[g_main_device], tensor->data, ggml_nbytes(tensor), cudaMemcpyHostToDevice));
+}
+
+void ggml_cuda_copy_to_host(struct ggml_tensor * tensor) {
+    GGML_ASSERT(tensor->backend == GGML_BACKEND_GPU);
+    GGML_ASSERT(ggml_is_contiguous(tensor));
+
+    struct ggml_tensor_extra_gpu * extra = (ggml_tensor_extra_gpu *) tensor->extra;
+    CUDA_CHECK(cudaSetDevice(g_main_device));
+    CUDA_CHECK(cudaMemcpy(tensor->data, extra->data_device[g_main_device], ggml_nbytes(tensor), cudaMemcpyDeviceToHost));
 }
 
 void ggml_cuda_set_main_device(int main_device) {
@@ -2887,6 +2958,10 @@ void ggml_cuda_set_main_device(int main_device) {
 }
 
 void ggml_cuda_set_scratch_size(size_t scratch_size) {
+    // a larger buffer is allocated on its next use
+    if (scratch_size > g_scratch_size) {
+        ggml_cuda_free_scratch();
+    }
     g_scratch_size = scratch_size;
 }
 
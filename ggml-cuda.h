@@ -29,6 +29,12 @@ void   ggml_cuda_transform_tensor(void * data, struct ggml_tensor * tensor);
 void   ggml_cuda_free_data(struct ggml_tensor * tensor);
 void   ggml_cuda_assign_buffers(struct ggml_tensor * tensor);
 void   ggml_cuda_assign_buffers_no_scratch(struct ggml_tensor * tensor);
+// like ggml_cuda_assign_buffers for the tensors of a graph placed by ggml-alloc: the VRAM is assigned
+// with ggml_cuda_assign_scratch_offset at the offset of the tensor in the host buffer of the allocator
+void   ggml_cuda_assign_buffers_no_alloc(struct ggml_tensor * tensor);
+void   ggml_cuda_assign_scratch_offset(struct ggml_tensor * tensor, size_t offset);
+void   ggml_cuda_copy_to_device(struct ggml_tensor * tensor);
+void   ggml_cuda_copy_to_host(struct ggml_tensor * tensor);
 void   ggml_cuda_set_main_device(int main_device);
 void   ggml_cuda_set_scratch_size(size_t scratch_size);
 void   ggml_cuda_free_scratch(void);
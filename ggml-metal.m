@@ -454,10 +454,14 @@ void ggml_metal_graph_compute(
                                 encoder = [command_buffer computeCommandEncoder];
                             }
 
+                            // src1 can be repeated over the matrices of src0
+                            const int64_t ne1x = ggml_nelements(src1);
+
                             [encoder setComputePipelineState:ctx->pipeline_add];
                             [encoder setBuffer:id_src0 offset:offs_src0 atIndex:0];
                             [encoder setBuffer:id_src1 offset:offs_src1 atIndex:1];
                             [encoder setBuffer:id_dst  offset:offs_dst  atIndex:2];
+                            [encoder setBytes:&ne1x length:sizeof(ne1x) atIndex:3];
 
                             const int64_t n = ggml_nelements(dst);
 
@@ -872,6 +876,14 @@ void ggml_metal_graph_compute(
 
                             const int n_past = ((int32_t *)(src1->data))[0];
 
+                            // the positions of ggml_rope_pos, the kernel does not read the buffer without them
+                            struct ggml_tensor * pos = dst->opt[0];
+
+                            const int has_pos = pos != NULL;
+
+                            size_t offs_pos = offs_dst;
+                            id<MTLBuffer> id_pos = pos ? ggml_metal_get_buffer(ctx, pos, &offs_pos) : id_dst;
+
                             [encoder setComputePipelineState:ctx->pipeline_rope];
                             [encoder setBuffer:id_src0 offset:offs_src0 atIndex:0];
                             [encoder setBuffer:id_dst  offset:offs_dst  atIndex:1];
@@ -894,6 +906,8 @@ void ggml_metal_graph_compute(
                             [encoder setBytes:&n_past length:sizeof(     int) atIndex:18];
                             [encoder setBytes:&n_dims length:sizeof(     int) atIndex:19];
                             [encoder setBytes:&mode   length:sizeof(     int) atIndex:20];
+                            [encoder setBytes:&has_pos length:sizeof(    int) atIndex:21];
+                            [encoder setBuffer:id_pos offset:offs_pos atIndex:22];
 
                             [encoder dispatchThreadgroups:MTLSizeMake(ne01, ne02, ne03) threadsPerThreadgroup:MTLSizeMake(1, 1, 1)];
                         } break;
@@ -59,12 +59,14 @@ static void dequantize_row_q4_1(device const block_q4_1 * x, device float * y, i
     }
 }
 
+// src1 is repeated over src0 when it has fewer elements (e.g. KQ_mask over the heads of KQ)
 kernel void kernel_add(
         device const float * src0,
         device const float * src1,
         device       float * dst,
+        constant   int64_t & ne1x,
         uint tpig[[thread_position_in_grid]]) {
-    dst[tpig] = src0[tpig] + src1[tpig];
+    dst[tpig] = src0[tpig] + src1[tpig % ne1x];
 }
 
 kernel void kernel_mul(
@@ -615,6 +617,8 @@ kernel void kernel_rope(
         constant       int & n_past,
         constant       int & n_dims,
         constant       int & mode,
+        constant       int & has_pos,
+        device const int32_t * pos,
         uint3 tpig[[thread_position_in_grid]]) {
     const int64_t i3 = tpig[2];
     const int64_t i2 = tpig[1];
@@ -623,7 +627,8 @@ kernel void kernel_rope(
     const bool is_neox = mode & 2;
     const float theta_scale = pow(10000.0, -2.0f/n_dims);
 
-    const int64_t p = ((mode & 1) == 0 ? n_past + i2 : i2);
+    // explicit position of each matrix with ggml_rope_pos
+    const int64_t p = has_pos ? pos[i2] : ((mode & 1) == 0 ? n_past + i2 : i2);
 
     float theta = (float)p;
 
@@ -0,0 +1,3 @@
+// the kernels of ggml-quants.c for the avx tier of GGML_CPU_DISPATCH
+#define GGML_QUANTS_TIER avx
+#include "ggml-quants.c"
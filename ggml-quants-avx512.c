@@ -0,0 +1,3 @@
+// the kernels of ggml-quants.c for the avx512 tier of GGML_CPU_DISPATCH
+#define GGML_QUANTS_TIER avx512
+#include "ggml-quants.c"
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "ggml-impl.h"
+
+#include <stdint.h>
+#include <assert.h>
+#include <stddef.h>
+
+//
+// Block quantization structures
+//
+
+#define QK4_0 32
+typedef struct {
+    ggml_fp16_t d;          // delta
+    uint8_t qs[QK4_0 / 2];  // nibbles / quants
+} block_q4_0;
+static_assert(sizeof(block_q4_0) == sizeof(ggml_fp16_t) + QK4_0 / 2, "wrong q4_0 block size/padding");
+
+// block i of 4 rows of q4_0, the quants of rows 2*j and 2*j + 1 are the low and the high nibbles of qs[j]
+typedef struct {
+    ggml_fp16_t d[4];       // deltas
+    uint8_t qs[2][QK4_0];   // nibbles / quants
+} block_q4_0x4;
+static_assert(sizeof(block_q4_0x4) == 4 * sizeof(block_q4_0), "wrong q4_0x4 block size/padding");
+
+#define QK4_1 32
+typedef struct {
+    ggml_fp16_t d;          // delta
+    ggml_fp16_t m;          // min
+    uint8_t qs[QK4_1 / 2];  // nibbles / quants
+} block_q4_1;
+static_assert(sizeof(block_q4_1) == 2 * sizeof(ggml_fp16_t) + QK4_1 / 2, "wrong q4_1 block size/padding");
+
+#define QK5_0 32
+typedef struct {
+    ggml_fp16_t d;         // delta
+    uint8_t qh[4];         // 5-th bit of quants
+    uint8_t qs[QK5_0 / 2]; // nibbles / quants
+} block_q5_0;
+static_assert(sizeof(block_q5_0) == sizeof(ggml_fp16_t) + sizeof(uint32_t) + QK5_0 / 2, "wrong q5_0 block size/padding");
+
+#define QK5_1 32
+typedef struct {
+    ggml_fp16_t d;         // delta
+    ggml_fp16_t m;         // min
+    uint8_t qh[4];         // 5-th bit of quants
+    uint8_t qs[QK5_1 / 2]; // nibbles / quants
+} block_q5_1;
+static_assert(sizeof(block_q5_1) == 2 * sizeof(ggml_fp16_t) + sizeof(uint32_t) + QK5_1 / 2, "wrong q5_1 block size/padding");
+
+#define QK8_0 32
+typedef struct {
+    ggml_fp16_t d;         // delta
+    int8_t  qs[QK8_0];     // quants
+} block_q8_0;
+static_assert(sizeof(block_q8_0) == sizeof(ggml_fp16_t) + QK8_0, "wrong q8_0 block size/padding");
+
+#define QK8_1 32
+typedef struct {
+    float d;               // delta
+    float s;               // d * sum(qs[i])
+    int8_t  qs[QK8_1];     // quants
+} block_q8_1;
+static_assert(sizeof(block_q8_1) == 2*sizeof(float) + QK8_1, "wrong q8_1 block size/padding");
+
+
+// Quantization
+void quantize_row_q4_0_reference(const float * restrict x, block_q4_0 * restrict y, int k);
+void quantize_row_q4_1_reference(const float * restrict x, block_q4_1 * restrict y, int k);
+void quantize_row_q5_0_reference(const float * restrict x, block_q5_0 * restrict y, int k);
+void quantize_row_q5_1_reference(const float * restrict x, block_q5_1 * restrict y, int k);
+void quantize_row_q8_0_reference(const float * restrict x, block_q8_0 * restrict y, int k);
+void quantize_row_q8_1_reference(const float * restrict x, block_q8_1 * restrict y, int k);
+
+void quantize_row_q4_0(const float * restrict x, void * restrict y, int k);
+void quantize_row_q4_1(const float * restrict x, void * restrict y, int k);
+void quantize_row_q5_0(const float * restrict x, void * restrict y, int k);
+void quantize_row_q5_1(const float * restrict x, void * restrict y, int k);
+void GGML_TIER_FN(quantize_row_q8_0)(const float * restrict x, void * restrict y, int k);
+void GGML_TIER_FN(quantize_row_q8_1)(const float * restrict x, void * restrict y, int k);
+
+// Dequantization
+void dequantize_row_q4_0(const block_q4_0 * restrict x, float * restrict y, int k);
+void dequantize_row_q4_1(const block_q4_1 * restrict x, float * restrict y, int k);
+void dequantize_row_q5_0(const block_q5_0 * restrict x, float * restrict y, int k);
+void dequantize_row_q5_1(const block_q5_1 * restrict x, float * restrict y, int k);
+void dequantize_row_q8_0(const void * restrict x, float * restrict y, int k);
+void dequantize_row_q8_1(const void * restrict x, float * restrict y, int k);
+
+// Dot product
+void GGML_TIER_FN(ggml_vec_dot_q4_0_q8_0)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q4_1_q8_1)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q5_0_q8_0)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q5_1_q8_1)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q8_0_q8_0)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+
+#if defined(__AVX2__)
+void GGML_TIER_FN(ggml_vec_dot_q4_0_q8_0_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q4_1_q8_1_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q5_0_q8_0_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q5_1_q8_1_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q8_0_q8_0_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q4_0x4_q8_0_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+#endif
+
+// Conversion of rows between fp16 and fp32
+typedef void (*ggml_vec_cvt_f16_f32_t)(const ggml_fp16_t * restrict x, float * restrict y, size_t n);
+typedef void (*ggml_vec_cvt_f32_f16_t)(const float * restrict x, ggml_fp16_t * restrict y, size_t n);
+
+void GGML_TIER_FN(ggml_vec_cvt_f16_f32)(const ggml_fp16_t * restrict x, float * restrict y, size_t n);
+void GGML_TIER_FN(ggml_vec_cvt_f32_f16)(const float * restrict x, ggml_fp16_t * restrict y, size_t n);
+
+// f32 and f16 vector kernels of ggml.c
+#define GGML_VEC_DOT_UNROLL 2
+
+void GGML_TIER_FN(ggml_vec_dot_f32_impl)       (int n, float * restrict s, const float * restrict x, const float * restrict y);
+void GGML_TIER_FN(ggml_vec_dot_f16_impl)       (int n, float * restrict s, ggml_fp16_t * restrict x, ggml_fp16_t * restrict y);
+void GGML_TIER_FN(ggml_vec_dot_f16_unroll_impl)(int n, int xs, float * restrict s, void * restrict xv, ggml_fp16_t * restrict y);
+void GGML_TIER_FN(ggml_vec_mad_f32_impl)       (int n, float * restrict y, const float * restrict x, float v);
+void GGML_TIER_FN(ggml_vec_scale_f32_impl)     (int n, float * y, float v);
+void GGML_TIER_FN(ggml_vec_mul_scale_f32_impl) (int n, float * z, const float * x, const float * y, float v);
+void GGML_TIER_FN(ggml_vec_swiglu_f32_impl)    (int n, float * y, const float * x, const float * g);
+
+typedef struct {
+    ggml_vec_cvt_f16_f32_t cvt_f16_f32;
+    ggml_vec_cvt_f32_f16_t cvt_f32_f16;
+    void (*dot_f32)       (int n, float * restrict s, const float * restrict x, const float * restrict y);
+    void (*dot_f16)       (int n, float * restrict s, ggml_fp16_t * restrict x, ggml_fp16_t * restrict y);
+    void (*dot_f16_unroll)(int n, int xs, float * restrict s, void * restrict xv, ggml_fp16_t * restrict y);
+    void (*mad_f32)       (int n, float * restrict y, const float * restrict x, float v);
+    void (*scale_f32)     (int n, float * y, float v);
+    void (*mul_scale_f32) (int n, float * z, const float * x, const float * y, float v);
+    void (*swiglu_f32)    (int n, float * y, const float * x, const float * g);
+} ggml_vec_fns_t;
+
+//
+// Runtime dispatch
+//
+// each x86 tier overrides the kernels of the quantize_fns table, including the k-quants ones, and the fp16 row
+// conversions and the f32/f16 vector kernels of ggml_vec_fns_t with its own builds - ggml_init calls the one of the
+// best tier supported by the CPU
+//
+
+#ifdef GGML_CPU_DISPATCH
+void ggml_quants_init_avx   (quantize_fns_t * fns, ggml_vec_fns_t * vec_fns);
+void ggml_quants_init_avx2  (quantize_fns_t * fns, ggml_vec_fns_t * vec_fns);
+void ggml_quants_init_avx512(quantize_fns_t * fns, ggml_vec_fns_t * vec_fns);
+#endif
@@ -229,6 +229,7 @@ extern "C" {
 
     struct ggml_object;
     struct ggml_context;
+    struct ggml_threadpool;
 
     enum ggml_type {
         GGML_TYPE_F32  = 0,
@@ -251,6 +252,9 @@ extern "C" {
         GGML_TYPE_I8,
         GGML_TYPE_I16,
         GGML_TYPE_I32,
+        // rows interleaved in groups of 4 for the CPU kernels (see ggml_repack)
+        GGML_TYPE_Q4_0_X4,
+        GGML_TYPE_Q4_K_X4,
         GGML_TYPE_COUNT,
     };
 
@@ -309,8 +313,10 @@ extern "C" {
         GGML_OP_NORM, // normalize
         GGML_OP_RMS_NORM,
         GGML_OP_RMS_NORM_BACK,
+        GGML_OP_RMS_NORM_MUL,
 
         GGML_OP_MUL_MAT,
+        GGML_OP_MUL_MAT_SWIGLU,
         GGML_OP_OUT_PROD,
 
         GGML_OP_SCALE,
@@ -339,6 +345,7 @@ extern "C" {
         GGML_OP_FLASH_ATTN,
         GGML_OP_FLASH_FF,
         GGML_OP_FLASH_ATTN_BACK,
+        GGML_OP_FLASH_ATTN_EXT,
         GGML_OP_WIN_PART,
         GGML_OP_WIN_UNPART,
 
@@ -409,12 +416,30 @@ extern "C" {
 
     static const size_t GGML_TENSOR_SIZE = sizeof(struct ggml_tensor);
 
+    // cost model used by ggml_graph_plan() to choose the number of threads of each node:
+    // a node takes flops/flops_per_us + bytes/bytes_per_us us on one thread,
+    // and each thread after the first one adds task_us of synchronization
+    struct ggml_cost_model {
+        float flops_per_us; // arithmetic throughput of one thread
+        float bytes_per_us; // memory bandwidth of one thread
+        float task_us;      // <= 0 to always use all the threads
+    };
+
     // computation graph
     struct ggml_cgraph {
         int n_nodes;
         int n_leafs;
         int n_threads;
 
+        // cost model used to plan the graph, NULL for ggml_cost_model_default()
+        const struct ggml_cost_model * cost_model;
+
+        // n_threads for which the n_tasks of the nodes and the work buffer were planned
+        // 0 if the graph has not been planned yet - reset when nodes are added
+        int n_planned;
+        // copy of the cost model the graph was planned with, the graph plans again when its model changes
+        struct ggml_cost_model cost_planned;
+
         size_t work_size;
         struct ggml_tensor * work;
 
@@ -459,6 +484,9 @@ extern "C" {
         // work buffer for all threads
         size_t wsize;
         void * wdata;
+
+        // counter of the chunks of the node handed out to its threads (atomic_int)
+        void * chunk;
     };
 
     // misc
@@ -796,6 +824,12 @@ extern "C" {
             struct ggml_tensor  * a,
             struct ggml_tensor  * b);
 
+    // rms_norm(a)*b in one op, b is broadcast to the rows of a
+    GGML_API struct ggml_tensor * ggml_rms_norm_mul(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b);
+
     // A: n columns, m rows
     // B: n columns, p rows  (i.e. we transpose it internally)
     // result is m columns, p rows
@@ -804,6 +838,27 @@ extern "C" {
             struct ggml_tensor  * a,
             struct ggml_tensor  * b);
 
+    // same as ggml_mul_mat, but the result is stored so that ggml_permute(result, axis0, axis1, axis2, axis3)
+    // is contiguous, e.g. to merge the heads of the attention without a copy - axis0 must be 0
+    GGML_API struct ggml_tensor * ggml_mul_mat_permuted(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            int                   axis0,
+            int                   axis1,
+            int                   axis2,
+            int                   axis3);
+
+    // silu(A*C)*(B*C) in one op, the gate and up projections of a SwiGLU feed-forward
+    // A, B: n columns, m rows, same type
+    // C: n columns, p rows
+    // result is m columns, p rows
+    GGML_API struct ggml_tensor * ggml_mul_mat_swiglu(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            struct ggml_tensor  * c);
+
     // A: m columns, n rows,
     // B: p columns, n rows,
     // result is m columns, p rows
@@ -812,6 +867,16 @@ extern "C" {
             struct ggml_tensor  * a,
             struct ggml_tensor  * b);
 
+    // same as ggml_out_prod, with the result stored like in ggml_mul_mat_permuted
+    GGML_API struct ggml_tensor * ggml_out_prod_permuted(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            int                   axis0,
+            int                   axis1,
+            int                   axis2,
+            int                   axis3);
+
     //
     // operations on tensors without backpropagation
     //
@@ -1055,6 +1120,25 @@ extern "C" {
             int                   mode,
             int                   n_ctx);
 
+    // rotary position embedding with an explicit position for each row
+    // b is an I32 vector with a->ne[2] elements, the position of each token
+    GGML_API struct ggml_tensor * ggml_rope_pos(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            int                   n_dims,
+            int                   mode,
+            int                   n_ctx);
+
+    // in-place, returns view(a)
+    GGML_API struct ggml_tensor * ggml_rope_pos_inplace(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * b,
+            int                   n_dims,
+            int                   mode,
+            int                   n_ctx);
+
     // rotary position embedding backward, i.e compute dx from dy
     // a - dy
     GGML_API struct ggml_tensor * ggml_rope_back(
@@ -1149,6 +1233,21 @@ extern "C" {
            struct ggml_tensor  * d,
            bool                  masked);
 
+    // fused attention with an online softmax, for inference only
+    // q:    [D, N,    n_head] F32
+    // k:    [D, n_kv, n_head] F32, F16, Q8_0 or Q4_0, rows of D contiguous elements
+    // v:    [D, n_kv, n_head] F32, F16, Q8_0 or Q4_0, rows of D contiguous elements
+    //       or F32, F16 with the n_kv elements contiguous (transposed V cache)
+    // mask: [n_kv, N] F32 added to the scaled scores, -INFINITY skips a cell, NULL for no mask
+    // res:  [D, n_head, N] F32, i.e. the heads of each token are already merged
+    GGML_API struct ggml_tensor * ggml_flash_attn_ext(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * q,
+            struct ggml_tensor  * k,
+            struct ggml_tensor  * v,
+            struct ggml_tensor  * mask,
+            float                 scale);
+
     GGML_API struct ggml_tensor * ggml_flash_ff(
             struct ggml_context * ctx,
             struct ggml_tensor  * a,
@@ -1270,8 +1369,28 @@ extern "C" {
     GGML_API struct ggml_cgraph ggml_build_forward (struct ggml_tensor * tensor);
     GGML_API struct ggml_cgraph ggml_build_backward(struct ggml_context * ctx, struct ggml_cgraph * gf, bool keep);
 
-    GGML_API void ggml_graph_compute(struct ggml_context * ctx, struct ggml_cgraph * cgraph);
-    GGML_API void ggml_graph_reset  (struct ggml_cgraph * cgraph);
+    // ggml_graph_compute() spawns cgraph->n_threads - 1 threads for every call
+    // to avoid this, create a thread pool once and pass it to ggml_graph_compute_pool()
+    // the pool can be used for any graph with cgraph->n_threads <= the pool size
+    GGML_API struct ggml_threadpool * ggml_threadpool_new      (int n_threads);
+    GGML_API void                     ggml_threadpool_free     (struct ggml_threadpool * pool);
+    GGML_API int                      ggml_threadpool_n_threads(const struct ggml_threadpool * pool);
+
+    // conservative values for a recent x86 core, used by the graphs without a cost model
+    GGML_API struct ggml_cost_model ggml_cost_model_default(void);
+
+    // measure the cost model on this host with the threads of the pool (NULL for a single thread)
+    // the arithmetic throughput is measured with a matrix product whose src0 has the given type, e.g. the type of the weights
+    // the result is only returned, set it in cgraph->cost_model of the graphs that should use it
+    GGML_API struct ggml_cost_model ggml_calibrate_cost_model(struct ggml_threadpool * pool, enum ggml_type type);
+
+    // plan the graph for cgraph->n_threads and return the size of the work buffer it needs
+    // the caller can provide the work buffer in cgraph->work, otherwise ggml_graph_compute() allocates it in ctx
+    GGML_API size_t ggml_graph_plan(struct ggml_cgraph * cgraph);
+
+    GGML_API void ggml_graph_compute     (struct ggml_context * ctx, struct ggml_cgraph * cgraph);
+    GGML_API void ggml_graph_compute_pool(struct ggml_context * ctx, struct ggml_cgraph * cgraph, struct ggml_threadpool * pool);
+    GGML_API void ggml_graph_reset       (struct ggml_cgraph * cgraph);
 
     GGML_API struct ggml_tensor * ggml_graph_get_tensor(struct ggml_cgraph * cgraph, const char * name);
 
@@ -1461,6 +1580,15 @@ extern "C" {
 
     GGML_API size_t ggml_quantize_chunk(enum ggml_type type, const float * src, void * dst, int start, int n, int64_t * hist);
 
+    // repacking of quantized matrices into layouts with the rows interleaved in groups of 4, for the CPU matrix multiplication
+    // the repacked tensors can only be used as src0 of ggml_mul_mat, the number of their rows must be a multiple of 4
+
+    // the type of the repacked rows, GGML_TYPE_COUNT if the type cannot be repacked or there is no kernel for this CPU
+    GGML_API enum ggml_type ggml_repack_type(enum ggml_type type);
+
+    // repacks nrows rows of n_per_row values of the given type, returns the size of the repacked data in bytes
+    GGML_API size_t ggml_repack(enum ggml_type type, const void * src, void * dst, int nrows, int n_per_row);
+
     //
     // system info
     //
@@ -1483,6 +1611,10 @@ extern "C" {
     GGML_API int ggml_cpu_has_sse3       (void);
     GGML_API int ggml_cpu_has_vsx        (void);
 
+    // the instruction set tier of the quantized kernels - avx512, avx2, avx or base
+    // chosen at runtime when built with GGML_CPU_DISPATCH and at compile time otherwise
+    GGML_API const char * ggml_cpu_tier(void);
+
     //
     // Internal types and functions exposed for tests and benchmarks
     //
@@ -1497,12 +1629,20 @@ extern "C" {
     typedef void (*quantize_row_q_t)  (const float * GGML_RESTRICT x, void * GGML_RESTRICT y, int k);
     typedef void (*vec_dot_q_t)       (const int n, float * GGML_RESTRICT s, const void * GGML_RESTRICT x, const void * GGML_RESTRICT y);
 
+    // dot products of GGML_VEC_DOT_Q_TILE_NX rows of x with ny <= GGML_VEC_DOT_Q_TILE_NY rows of y:
+    //   s[j*bs + i] = dot(x + i*bx, y + j*by)
+    // for the interleaved types x is a group of GGML_VEC_DOT_Q_TILE_NX rows and bx is not used
+#define GGML_VEC_DOT_Q_TILE_NX 4
+#define GGML_VEC_DOT_Q_TILE_NY 4
+    typedef void (*vec_dot_q_tile_t)  (const int n, float * GGML_RESTRICT s, size_t bs, const void * GGML_RESTRICT x, size_t bx, const void * GGML_RESTRICT y, size_t by, int ny);
+
     typedef struct {
         dequantize_row_q_t dequantize_row_q;
         quantize_row_q_t   quantize_row_q;
         quantize_row_q_t   quantize_row_q_reference;
         quantize_row_q_t   quantize_row_q_dot;
         vec_dot_q_t        vec_dot_q;
+        vec_dot_q_tile_t   vec_dot_q_tile; // NULL if the type has no tiled kernel for this CPU
         enum ggml_type     vec_dot_type;
     } quantize_fns_t;
 
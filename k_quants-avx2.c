@@ -0,0 +1,3 @@
+// the kernels of k_quants.c for the avx2 tier of GGML_CPU_DISPATCH
+#define GGML_QUANTS_TIER avx2
+#include "k_quants.c"
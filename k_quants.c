@@ -43,6 +43,7 @@
 // 2-6 bit quantization in super-blocks
 //
 
+#ifndef GGML_QUANTS_TIER
 
 //
 // ===================== Helper functions
@@ -786,6 +787,31 @@ size_t ggml_quantize_q4_K(const float * restrict src, void * restrict dst, int n
     return (n/QK_K*sizeof(block_q4_K));
 }
 
+#if QK_K == 256
+size_t ggml_repack_q4_K(const block_q4_K * restrict x, block_q4_Kx4 * restrict y, int nrows, int n_per_row) {
+    assert(nrows % 4 == 0);
+    assert(n_per_row % QK_K == 0);
+    const int nb = n_per_row / QK_K;
+
+    for (int ig = 0; ig < nrows/4; ++ig) {
+        for (int i = 0; i < nb; ++i) {
+            block_q4_Kx4 * restrict b = y + ig*nb + i;
+            for (int ir = 0; ir < 4; ++ir) {
+                const block_q4_K * restrict xr = x + (4*ig + ir)*nb + i;
+                b->d[ir]    = xr->d;
+                b->dmin[ir] = xr->dmin;
+                for (int j = 0; j < QK_K/32; ++j) {
+                    get_scale_min_k4(j, xr->scales, &b->scales[ir][j], &b->mins[ir][j]);
+                }
+                memcpy(b->qs[ir], xr->qs, QK_K/2);
+            }
+        }
+    }
+
+    return (size_t)nrows/4*nb*sizeof(block_q4_Kx4);
+}
+#endif
+
 // ====================== 5-bit (de)-quantization
 
 void quantize_row_q5_K_reference(const float * restrict x, block_q5_K * restrict y, int k) {
@@ -1182,6 +1208,10 @@ void quantize_row_q8_K(const float * restrict x, void * restrict y, int k) {
     quantize_row_q8_K_reference(x, y, k);
 }
 
+#endif // GGML_QUANTS_TIER
+
+// the dot products below depend on the instruction set and are compiled once per tier with GGML_CPU_DISPATCH
+
 //===================================== Dot ptoducts =================================
 
 //
@@ -1236,8 +1266,50 @@ static inline __m128i get_scale_shuffle(int i) {
 }
 #endif
 
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define MM512_SET_M256I(a, b) _mm512_inserti64x4(_mm512_castsi256_si512(b), (a), 1)
+
+// multiply unsigned int8_t with int8_t, add the products in groups of 4 and accumulate them to the int32_t lanes of acc
+// without VNNI the products are added pairwise as int16_t first, so ax must not exceed 128
+static inline __m512i mul_add_us8_quads(const __m512i acc, const __m512i ax, const __m512i sy) {
+#if defined(__AVX512VNNI__)
+    return _mm512_dpbusd_epi32(acc, ax, sy);
+#else
+    const __m512i dot = _mm512_maddubs_epi16(ax, sy);
+    return _mm512_add_epi32(acc, _mm512_madd_epi16(dot, _mm512_set1_epi16(1)));
+#endif
+}
+
+// the 512-bit dot products below work on 64 quants at a time, the sums of the groups of 4 products fit in
+// 16 bits and are multiplied with the scales by _mm512_madd_epi16, with the scale in the low half of each lane
+
+// the int8_t scales of the 16 blocks of 16 of a super-block, one per 32-bit lane
+static inline __m512i get_scales_k16(const __m128i scales8) {
+    return _mm512_cvtepu16_epi32(_mm256_cvtepi8_epi16(scales8));
+}
+
+// the scales of the groups of 4 of the j-th 64 quants, from the scales of the blocks of 16
+static inline __m512i get_scale_k16(const __m512i scales, int j) {
+    const __m512i idx = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    return _mm512_permutexvar_epi32(_mm512_add_epi32(idx, _mm512_set1_epi32(4*j)), scales);
+}
+
+// the scales of the groups of 4 of the j-th 64 quants, from the scales of the blocks of 32
+static inline __m512i get_scale_k32(const __m512i scales, int j) {
+    const __m512i idx = _mm512_set_epi32(1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+    return _mm512_permutexvar_epi32(_mm512_add_epi32(idx, _mm512_set1_epi32(2*j)), scales);
+}
+
+// the 2-bit quants of the j-th 64 quants of Q2_K and Q3_K, from the 32 bytes of their half of the super-block
+static inline __m512i get_q2_k(const __m256i q2bits, int j) {
+    const __m512i m3 = _mm512_set1_epi8(3);
+    const __m512i q2 = MM512_SET_M256I(_mm256_srli_epi16(q2bits, 2), q2bits);
+    return _mm512_and_si512(j % 2 == 0 ? q2 : _mm512_srli_epi16(q2, 4), m3);
+}
+#endif
+
 #if QK_K == 256
-void ggml_vec_dot_q2_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q2_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
 
     const block_q2_K * restrict x = vx;
     const block_q8_K * restrict y = vy;
@@ -1327,6 +1399,50 @@ void ggml_vec_dot_q2_K_q8_K(const int n, float * restrict s, const void * restri
 
     *s = sum;
 
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+
+    const __m128i m4 = _mm_set1_epi8(0xF);
+
+    __m512 acc = _mm512_setzero_ps();
+    __m256 acc_m = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * GGML_FP16_TO_FP32(x[i].d);
+        const float dmin = -y[i].d * GGML_FP16_TO_FP32(x[i].dmin);
+
+        const uint8_t * restrict q2 = x[i].qs;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const __m128i mins_and_scales = _mm_loadu_si128((const __m128i*)x[i].scales);
+        const __m128i scales8 = _mm_and_si128(mins_and_scales, m4);
+        const __m128i mins8 = _mm_and_si128(_mm_srli_epi16(mins_and_scales, 4), m4);
+        const __m256i mins = _mm256_cvtepi8_epi16(mins8);
+        const __m256i prod = _mm256_madd_epi16(mins, _mm256_loadu_si256((const __m256i*)y[i].bsums));
+
+        acc_m = _mm256_fmadd_ps(_mm256_broadcast_ss(&dmin), _mm256_cvtepi32_ps(prod), acc_m);
+
+        const __m512i scales = get_scales_k16(scales8);
+
+        __m512i sumi = _mm512_setzero_si512();
+
+        for (int j = 0; j < QK_K/64; ++j) {
+
+            const __m256i q2bits = _mm256_loadu_si256((const __m256i*)q2 + j/2);
+
+            const __m512i q8x = _mm512_loadu_si512((const __m512i*)q8); q8 += 64;
+
+            const __m512i p = mul_add_us8_quads(_mm512_setzero_si512(), get_q2_k(q2bits, j), q8x);
+
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(p, get_scale_k16(scales, j)));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+
+    }
+
+    *s = _mm512_reduce_add_ps(acc) + hsum_float_8(acc_m);
+
 #elif defined __AVX2__
 
     const __m256i m3 = _mm256_set1_epi8(3);
@@ -1544,7 +1660,7 @@ void ggml_vec_dot_q2_K_q8_K(const int n, float * restrict s, const void * restri
 
 #else
 
-void ggml_vec_dot_q2_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q2_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
 
     const block_q2_K * restrict x = vx;
     const block_q8_K * restrict y = vy;
@@ -1704,7 +1820,7 @@ void ggml_vec_dot_q2_K_q8_K(const int n, float * restrict s, const void * restri
 #endif
 
 #if QK_K == 256
-void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q3_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const uint32_t kmask1 = 0x03030303;
@@ -1833,6 +1949,67 @@ void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restri
 
     *s = sum;
 
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+
+    const __m128i m32 = _mm_set1_epi8(32);
+    const __m512i m4  = _mm512_set1_epi8(4);
+
+    __m512 acc = _mm512_setzero_ps();
+    __m256 acc_m = _mm256_setzero_ps();
+
+    uint32_t aux[3];
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * GGML_FP16_TO_FP32(x[i].d);
+
+        const uint8_t * restrict q3 = x[i].qs;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        // Set up scales
+        memcpy(aux, x[i].scales, 12);
+        __m128i scales128 = _mm_set_epi32(
+                ((aux[1] >> 4) & kmask2) | (((aux[2] >> 6) & kmask1) << 4),
+                ((aux[0] >> 4) & kmask2) | (((aux[2] >> 4) & kmask1) << 4),
+                (aux[1] & kmask2) | (((aux[2] >> 2) & kmask1) << 4),
+                (aux[0] & kmask2) | (((aux[2] >> 0) & kmask1) << 4));
+        scales128 = _mm_sub_epi8(scales128, m32);
+
+        // the quants are used with an offset of 4, so that they are unsigned, and the offset is subtracted
+        // with the sums of the blocks of 16 of y
+        const __m256i prod = _mm256_madd_epi16(_mm256_cvtepi8_epi16(scales128), _mm256_loadu_si256((const __m256i*)y[i].bsums));
+        acc_m = _mm256_fmadd_ps(_mm256_set1_ps(-4.0f*d), _mm256_cvtepi32_ps(prod), acc_m);
+
+        const __m512i scales = get_scales_k16(scales128);
+
+        // high bit, the bits j and j+1 of the 32 bytes are the high bits of the j-th 64 quants
+        const __m256i hbits = _mm256_loadu_si256((const __m256i*)x[i].hmask);
+        const __m512i hbits2 = MM512_SET_M256I(hbits, hbits);
+        __m512i hmask = MM512_SET_M256I(_mm256_set1_epi8(2), _mm256_set1_epi8(1));
+
+        __m512i sumi = _mm512_setzero_si512();
+
+        for (int j = 0; j < QK_K/64; ++j) {
+
+            const __m256i q3bits = _mm256_loadu_si256((const __m256i*)q3 + j/2);
+
+            __m512i q3x = get_q2_k(q3bits, j);
+            q3x = _mm512_mask_add_epi8(q3x, _mm512_test_epi8_mask(hbits2, hmask), q3x, m4);
+            hmask = _mm512_slli_epi16(hmask, 2);
+
+            const __m512i q8x = _mm512_loadu_si512((const __m512i*)q8); q8 += 64;
+
+            const __m512i p = mul_add_us8_quads(_mm512_setzero_si512(), q3x, q8x);
+
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(p, get_scale_k16(scales, j)));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+
+    }
+
+    *s = _mm512_reduce_add_ps(acc) + hsum_float_8(acc_m);
+
 #elif defined __AVX2__
 
     const __m256i m3 = _mm256_set1_epi8(3);
@@ -1946,7 +2123,7 @@ void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restri
 
     __m256 acc = _mm256_setzero_ps();
 
-    uint32_t *aux;
+    const uint32_t *aux;
 
     for (int i = 0; i < nb; ++i) {
 
@@ -1956,7 +2133,7 @@ void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restri
         const int8_t  * restrict q8 = y[i].qs;
 
         // Set up scales
-        aux = (uint32_t *)x[i].scales;
+        aux = (const uint32_t *)x[i].scales;
         __m128i scales128 = _mm_set_epi32(
                 ((aux[1] >> 4) & kmask2) | (((aux[2] >> 6) & kmask1) << 4),
                 ((aux[0] >> 4) & kmask2) | (((aux[2] >> 4) & kmask1) << 4),
@@ -2148,7 +2325,7 @@ void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restri
 
 #else
 
-void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q3_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q3_K * restrict x = vx;
@@ -2346,7 +2523,7 @@ void ggml_vec_dot_q3_K_q8_K(const int n, float * restrict s, const void * restri
 #endif
 
 #if QK_K == 256
-void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q4_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q4_K * restrict x = vx;
@@ -2447,6 +2624,61 @@ void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restri
 
     *s = sumf;
 
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+
+    const __m512i m4 = _mm512_set1_epi8(0xF);
+
+    __m512 acc = _mm512_setzero_ps();
+    __m128 acc_m = _mm_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * GGML_FP16_TO_FP32(x[i].d);
+        const float dmin = -y[i].d * GGML_FP16_TO_FP32(x[i].dmin);
+
+        memcpy(utmp, x[i].scales, 12);
+        utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+        const uint32_t uaux = utmp[1] & kmask1;
+        utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+        utmp[2] = uaux;
+        utmp[0] &= kmask1;
+
+        const uint8_t * restrict q4 = x[i].qs;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const __m128i mins8 = _mm_set_epi32(0, 0, utmp[3], utmp[2]);
+
+        const __m256i q8sums = _mm256_loadu_si256((const __m256i*)y[i].bsums);
+        const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+        const __m128i prod = _mm_madd_epi16(_mm_cvtepu8_epi16(mins8), q8s);
+        acc_m = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(prod), acc_m);
+
+        const __m512i scales = _mm512_cvtepu8_epi32(_mm_set_epi32(0, 0, utmp[1], utmp[0]));
+
+        __m512i sumi = _mm512_setzero_si512();
+
+        for (int j = 0; j < QK_K/64; ++j) {
+
+            // the low nibbles are the quants of the block 2j, the high nibbles those of the block 2j+1
+            const __m256i q4bits = _mm256_loadu_si256((const __m256i*)q4); q4 += 32;
+            const __m512i q4x = _mm512_and_si512(MM512_SET_M256I(_mm256_srli_epi16(q4bits, 4), q4bits), m4);
+
+            const __m512i q8x = _mm512_loadu_si512((const __m512i*)q8); q8 += 64;
+
+            const __m512i p = mul_add_us8_quads(_mm512_setzero_si512(), q4x, q8x);
+
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(p, get_scale_k32(scales, j)));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+
+    }
+
+    acc_m = _mm_add_ps(acc_m, _mm_movehl_ps(acc_m, acc_m));
+    acc_m = _mm_add_ss(acc_m, _mm_movehdup_ps(acc_m));
+
+    *s = _mm512_reduce_add_ps(acc) + _mm_cvtss_f32(acc_m);
+
 #elif defined __AVX2__
 
     const __m256i m4 = _mm256_set1_epi8(0xF);
@@ -2654,7 +2886,7 @@ void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restri
 #endif
 }
 #else
-void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q4_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q4_K * restrict x = vx;
@@ -2823,7 +3055,7 @@ void ggml_vec_dot_q4_K_q8_K(const int n, float * restrict s, const void * restri
 #endif
 
 #if QK_K == 256
-void ggml_vec_dot_q5_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q5_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q5_K * restrict x = vx;
@@ -2924,6 +3156,69 @@ void ggml_vec_dot_q5_K_q8_K(const int n, float * restrict s, const void * restri
 
     *s = sumf;
 
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+
+    const __m512i m4  = _mm512_set1_epi8(0xF);
+    const __m512i m16 = _mm512_set1_epi8(16);
+
+    __m512 acc = _mm512_setzero_ps();
+    __m128 acc_m = _mm_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * GGML_FP16_TO_FP32(x[i].d);
+        const float dmin = -y[i].d * GGML_FP16_TO_FP32(x[i].dmin);
+
+        memcpy(utmp, x[i].scales, 12);
+        utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+        const uint32_t uaux = utmp[1] & kmask1;
+        utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+        utmp[2] = uaux;
+        utmp[0] &= kmask1;
+
+        const uint8_t * restrict q5 = x[i].qs;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const __m128i mins8 = _mm_set_epi32(0, 0, utmp[3], utmp[2]);
+
+        const __m256i q8sums = _mm256_loadu_si256((const __m256i*)y[i].bsums);
+        const __m128i q8s = _mm_hadd_epi16(_mm256_extracti128_si256(q8sums, 0), _mm256_extracti128_si256(q8sums, 1));
+        const __m128i prod = _mm_madd_epi16(_mm_cvtepu8_epi16(mins8), q8s);
+        acc_m = _mm_fmadd_ps(_mm_set1_ps(dmin), _mm_cvtepi32_ps(prod), acc_m);
+
+        const __m512i scales = _mm512_cvtepu8_epi32(_mm_set_epi32(0, 0, utmp[1], utmp[0]));
+
+        // the bits 2j and 2j+1 of the 32 bytes are the 5-th bits of the blocks 2j and 2j+1
+        const __m256i hbits = _mm256_loadu_si256((const __m256i*)x[i].qh);
+        const __m512i hbits2 = MM512_SET_M256I(hbits, hbits);
+        __m512i hmask = MM512_SET_M256I(_mm256_set1_epi8(2), _mm256_set1_epi8(1));
+
+        __m512i sumi = _mm512_setzero_si512();
+
+        for (int j = 0; j < QK_K/64; ++j) {
+
+            const __m256i q5bits = _mm256_loadu_si256((const __m256i*)q5); q5 += 32;
+
+            __m512i q5x = _mm512_and_si512(MM512_SET_M256I(_mm256_srli_epi16(q5bits, 4), q5bits), m4);
+            q5x = _mm512_mask_add_epi8(q5x, _mm512_test_epi8_mask(hbits2, hmask), q5x, m16);
+            hmask = _mm512_slli_epi16(hmask, 2);
+
+            const __m512i q8x = _mm512_loadu_si512((const __m512i*)q8); q8 += 64;
+
+            const __m512i p = mul_add_us8_quads(_mm512_setzero_si512(), q5x, q8x);
+
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(p, get_scale_k32(scales, j)));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+
+    }
+
+    acc_m = _mm_add_ps(acc_m, _mm_movehl_ps(acc_m, acc_m));
+    acc_m = _mm_add_ss(acc_m, _mm_movehdup_ps(acc_m));
+
+    *s = _mm512_reduce_add_ps(acc) + _mm_cvtss_f32(acc_m);
+
 #elif defined __AVX2__
 
     const __m256i m4 = _mm256_set1_epi8(0xF);
@@ -3175,7 +3470,7 @@ void ggml_vec_dot_q5_K_q8_K(const int n, float * restrict s, const void * restri
 
 #else
 
-void ggml_vec_dot_q5_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q5_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q5_K * restrict x = vx;
@@ -3336,7 +3631,7 @@ void ggml_vec_dot_q5_K_q8_K(const int n, float * restrict s, const void * restri
 
 
 #if QK_K == 256
-void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q6_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q6_K * restrict x = vx;
@@ -3481,6 +3776,60 @@ void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restri
     }
     *s = sum;
 
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+
+    const __m512i m4 = _mm512_set1_epi8(0xF);
+    const __m512i m2 = _mm512_set1_epi8(3);
+
+    __m512 acc = _mm512_setzero_ps();
+    __m256 acc_m = _mm256_setzero_ps();
+
+    for (int i = 0; i < nb; ++i) {
+
+        const float d = y[i].d * GGML_FP16_TO_FP32(x[i].d);
+
+        const uint8_t * restrict q4 = x[i].ql;
+        const uint8_t * restrict qh = x[i].qh;
+        const int8_t  * restrict q8 = y[i].qs;
+
+        const __m128i scales8 = _mm_loadu_si128((const __m128i*)x[i].scales);
+
+        // the offset of 32 of the quants is subtracted with the sums of the blocks of 16 of y
+        const __m256i prod = _mm256_madd_epi16(_mm256_cvtepi8_epi16(scales8), _mm256_loadu_si256((const __m256i*)y[i].bsums));
+        acc_m = _mm256_fmadd_ps(_mm256_set1_ps(-32.0f*d), _mm256_cvtepi32_ps(prod), acc_m);
+
+        const __m512i scales = get_scales_k16(scales8);
+
+        __m512i sumi = _mm512_setzero_si512();
+
+        for (int j = 0; j < QK_K/128; ++j) {
+
+            // the low nibbles of the 64 bytes are the low 4 bits of the first 64 quants, the high nibbles those
+            // of the next 64, with the high 2 bits at the shifts 0, 2 and 4, 6 of the 32 bytes of qh
+            const __m512i q4bits = _mm512_loadu_si512((const __m512i*)q4); q4 += 64;
+            const __m256i q4bitsH = _mm256_loadu_si256((const __m256i*)qh); qh += 32;
+            const __m512i q4h = MM512_SET_M256I(_mm256_srli_epi16(q4bitsH, 2), q4bitsH);
+
+            const __m512i q6_0 = _mm512_or_si512(_mm512_and_si512(q4bits, m4),
+                                                 _mm512_slli_epi16(_mm512_and_si512(q4h, m2), 4));
+            const __m512i q6_1 = _mm512_or_si512(_mm512_and_si512(_mm512_srli_epi16(q4bits, 4), m4),
+                                                 _mm512_slli_epi16(_mm512_and_si512(_mm512_srli_epi16(q4h, 4), m2), 4));
+
+            const __m512i q8_0 = _mm512_loadu_si512((const __m512i*)q8); q8 += 64;
+            const __m512i q8_1 = _mm512_loadu_si512((const __m512i*)q8); q8 += 64;
+
+            const __m512i p0 = mul_add_us8_quads(_mm512_setzero_si512(), q6_0, q8_0);
+            const __m512i p1 = mul_add_us8_quads(_mm512_setzero_si512(), q6_1, q8_1);
+
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(p0, get_scale_k16(scales, 2*j+0)));
+            sumi = _mm512_add_epi32(sumi, _mm512_madd_epi16(p1, get_scale_k16(scales, 2*j+1)));
+        }
+
+        acc = _mm512_fmadd_ps(_mm512_set1_ps(d), _mm512_cvtepi32_ps(sumi), acc);
+    }
+
+    *s = _mm512_reduce_add_ps(acc) + hsum_float_8(acc_m);
+
 #elif defined __AVX2__
 
     const __m256i m4 = _mm256_set1_epi8(0xF);
@@ -3725,7 +4074,7 @@ void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restri
 
 #else
 
-void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
+void GGML_TIER_FN(ggml_vec_dot_q6_K_q8_K)(const int n, float * restrict s, const void * restrict vx, const void * restrict vy) {
     assert(n % QK_K == 0);
 
     const block_q6_K * restrict x = vx;
@@ -3898,3 +4247,195 @@ void ggml_vec_dot_q6_K_q8_K(const int n, float * restrict s, const void * restri
 }
 
 #endif
+
+#if QK_K == 256 && defined __AVX2__
+//
+// tiles of dot products for the batched matrix multiplication, see vec_dot_q_tile_t in ggml.h
+// the super-blocks of each row of x are decoded once to unsigned quants with their 16-bit scales and the
+// terms multiplied by the block sums of y (the mins of Q4_K and Q5_K, the offset of the quants of Q6_K),
+// then multiplied with the ny rows of y
+// the rows of Q4_K_X4 are decoded the same way as Q4_K, without unpacking the scales and the mins
+//
+typedef struct {
+    __m256i q[QK_K/32];  // quants
+    __m256i sc[QK_K/32]; // scales of the quants, one per 16-bit lane
+    __m256i m;           // multipliers of the 16 block sums of y
+    float   d;           // scale of sc
+    float   dm;          // scale of m
+} block_k_decoded;
+
+// ix is the row of the interleaved types
+static inline __attribute__((always_inline)) void decode_k_tile(enum ggml_type type, const void * restrict vx, int ix, block_k_decoded * restrict r) {
+    static const uint32_t kmask1 = 0x3f3f3f3f;
+    static const uint32_t kmask2 = 0x0f0f0f0f;
+    static const uint32_t kmask3 = 0x03030303;
+
+    const __m256i m4 = _mm256_set1_epi8(0xF);
+
+    if (type == GGML_TYPE_Q4_K || type == GGML_TYPE_Q5_K || type == GGML_TYPE_Q4_K_X4) {
+        const block_q4_K   * restrict x4 = vx;
+        const block_q5_K   * restrict x5 = vx;
+        const block_q4_Kx4 * restrict xi = vx;
+
+        const uint8_t * restrict qs;
+        __m128i sc128;
+        __m128i mins;
+
+        // each min multiplies the sums of the two blocks of 16 of y in its block of 32
+        const __m128i mins_shuffle = _mm_set_epi8(7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);
+
+        if (type == GGML_TYPE_Q4_K_X4) {
+            // the scales and mins are already unpacked
+            sc128 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) xi->scales[ix]));
+            mins  = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *) xi->mins[ix]), mins_shuffle);
+            qs    = xi->qs[ix];
+            r->d  =  ggml_fp16_to_fp32(xi->d[ix]);
+            r->dm = -ggml_fp16_to_fp32(xi->dmin[ix]);
+        } else {
+            const uint8_t * restrict scales = type == GGML_TYPE_Q4_K ? x4->scales : x5->scales;
+
+            uint32_t utmp[4];
+            memcpy(utmp, scales, 12);
+            utmp[3] = ((utmp[2] >> 4) & kmask2) | (((utmp[1] >> 6) & kmask3) << 4);
+            const uint32_t uaux = utmp[1] & kmask1;
+            utmp[1] = (utmp[2] & kmask2) | (((utmp[0] >> 6) & kmask3) << 4);
+            utmp[2] = uaux;
+            utmp[0] &= kmask1;
+
+            sc128 = _mm_cvtepu8_epi16(_mm_set_epi32(0, 0, utmp[1], utmp[0]));
+            mins  = _mm_shuffle_epi8(_mm_set_epi32(0, 0, utmp[3], utmp[2]), mins_shuffle);
+            qs    = type == GGML_TYPE_Q4_K ? x4->qs : x5->qs;
+            r->d  =  ggml_fp16_to_fp32(type == GGML_TYPE_Q4_K ? x4->d    : x5->d);
+            r->dm = -ggml_fp16_to_fp32(type == GGML_TYPE_Q4_K ? x4->dmin : x5->dmin);
+        }
+
+        const __m256i sc = _mm256_set_m128i(sc128, sc128);
+
+        r->m = _mm256_cvtepu8_epi16(mins);
+
+        const __m256i hbits = type == GGML_TYPE_Q5_K ? _mm256_loadu_si256((const __m256i *) x5->qh) : _mm256_setzero_si256();
+
+        for (int j = 0; j < QK_K/64; ++j) {
+            const __m256i qbits = _mm256_loadu_si256((const __m256i *) qs + j);
+
+            r->q[2*j+0] = _mm256_and_si256(qbits, m4);
+            r->q[2*j+1] = _mm256_and_si256(_mm256_srli_epi16(qbits, 4), m4);
+
+            if (type == GGML_TYPE_Q5_K) {
+                const __m256i m1 = _mm256_set1_epi8(1);
+                r->q[2*j+0] = _mm256_or_si256(r->q[2*j+0], _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(hbits, 2*j+0), m1), 4));
+                r->q[2*j+1] = _mm256_or_si256(r->q[2*j+1], _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(hbits, 2*j+1), m1), 4));
+            }
+
+            r->sc[2*j+0] = _mm256_shuffle_epi8(sc, get_scale_shuffle_k4(2*j+0));
+            r->sc[2*j+1] = _mm256_shuffle_epi8(sc, get_scale_shuffle_k4(2*j+1));
+        }
+    } else {
+        const block_q6_K * restrict x = vx;
+
+        const __m256i m2 = _mm256_set1_epi8(3);
+
+        const __m128i scales = _mm_loadu_si128((const __m128i *) x->scales);
+
+        // the quants are stored with an offset of 32
+        r->m  = _mm256_cvtepi8_epi16(scales);
+        r->d  = ggml_fp16_to_fp32(x->d);
+        r->dm = -32.0f*r->d;
+
+        for (int j = 0; j < QK_K/128; ++j) {
+            const __m256i q4bits1 = _mm256_loadu_si256((const __m256i *) x->ql + 2*j + 0);
+            const __m256i q4bits2 = _mm256_loadu_si256((const __m256i *) x->ql + 2*j + 1);
+            const __m256i q4bitsH = _mm256_loadu_si256((const __m256i *) x->qh + j);
+
+            r->q[4*j+0] = _mm256_or_si256(_mm256_and_si256(q4bits1, m4),                      _mm256_slli_epi16(_mm256_and_si256(q4bitsH, m2), 4));
+            r->q[4*j+1] = _mm256_or_si256(_mm256_and_si256(q4bits2, m4),                      _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 2), m2), 4));
+            r->q[4*j+2] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits1, 4), m4), _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 4), m2), 4));
+            r->q[4*j+3] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4bits2, 4), m4), _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(q4bitsH, 6), m2), 4));
+
+            for (int k = 0; k < 4; ++k) {
+                r->sc[4*j+k] = _mm256_cvtepi8_epi16(_mm_shuffle_epi8(scales, get_scale_shuffle(4*j+k)));
+            }
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void ggml_vec_dot_k_q8_K_tile_ny(
+        enum ggml_type type, const int n, float * restrict s, size_t bs,
+        const void * restrict vx, size_t bx, const void * restrict vy, size_t by, const int ny) {
+    assert(n % QK_K == 0);
+    assert(ny <= GGML_VEC_DOT_Q_TILE_NY);
+
+    const int nb = n / QK_K;
+
+    const size_t type_size = type == GGML_TYPE_Q4_K ? sizeof(block_q4_K) : type == GGML_TYPE_Q5_K ? sizeof(block_q5_K) : sizeof(block_q6_K);
+
+    __m256 acc[GGML_VEC_DOT_Q_TILE_NX][GGML_VEC_DOT_Q_TILE_NY];
+
+    for (int ix = 0; ix < GGML_VEC_DOT_Q_TILE_NX; ++ix) {
+        for (int iy = 0; iy < ny; ++iy) {
+            acc[ix][iy] = _mm256_setzero_ps();
+        }
+    }
+
+    block_k_decoded r;
+
+    for (int i = 0; i < nb; ++i) {
+        for (int ix = 0; ix < GGML_VEC_DOT_Q_TILE_NX; ++ix) {
+            if (type == GGML_TYPE_Q4_K_X4) {
+                decode_k_tile(type, (const block_q4_Kx4 *) vx + i, ix, &r);
+            } else {
+                decode_k_tile(type, (const char *) vx + ix*bx + i*type_size, 0, &r);
+            }
+
+            for (int iy = 0; iy < ny; ++iy) {
+                const block_q8_K * restrict y = (const block_q8_K *) ((const char *) vy + iy*by) + i;
+
+                __m256i sumi = _mm256_setzero_si256();
+
+                for (int k = 0; k < QK_K/32; ++k) {
+                    const __m256i q8 = _mm256_loadu_si256((const __m256i *) y->qs + k);
+                    sumi = _mm256_add_epi32(sumi, _mm256_madd_epi16(r.sc[k], _mm256_maddubs_epi16(r.q[k], q8)));
+                }
+
+                const __m256i summ = _mm256_madd_epi16(r.m, _mm256_loadu_si256((const __m256i *) y->bsums));
+
+                acc[ix][iy] = _mm256_fmadd_ps(_mm256_set1_ps(r.d *y->d), _mm256_cvtepi32_ps(sumi), acc[ix][iy]);
+                acc[ix][iy] = _mm256_fmadd_ps(_mm256_set1_ps(r.dm*y->d), _mm256_cvtepi32_ps(summ), acc[ix][iy]);
+            }
+        }
+    }
+
+    for (int iy = 0; iy < ny; ++iy) {
+        for (int ix = 0; ix < GGML_VEC_DOT_Q_TILE_NX; ++ix) {
+            s[iy*bs + ix] = hsum_float_8(acc[ix][iy]);
+        }
+    }
+}
+
+// full tiles and single columns with a constant number of columns
+static inline __attribute__((always_inline)) void ggml_vec_dot_k_q8_K_tile(
+        enum ggml_type type, const int n, float * restrict s, size_t bs,
+        const void * restrict vx, size_t bx, const void * restrict vy, size_t by, const int ny) {
+    switch (ny) {
+        case GGML_VEC_DOT_Q_TILE_NY: ggml_vec_dot_k_q8_K_tile_ny(type, n, s, bs, vx, bx, vy, by, GGML_VEC_DOT_Q_TILE_NY); break;
+        case 1:                      ggml_vec_dot_k_q8_K_tile_ny(type, n, s, bs, vx, bx, vy, by, 1);                      break;
+        default:                     ggml_vec_dot_k_q8_K_tile_ny(type, n, s, bs, vx, bx, vy, by, ny);                     break;
+    }
+}
+
+void GGML_TIER_FN(ggml_vec_dot_q4_K_q8_K_tile)(const int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny) {
+    ggml_vec_dot_k_q8_K_tile(GGML_TYPE_Q4_K, n, s, bs, vx, bx, vy, by, ny);
+}
+
+void GGML_TIER_FN(ggml_vec_dot_q5_K_q8_K_tile)(const int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny) {
+    ggml_vec_dot_k_q8_K_tile(GGML_TYPE_Q5_K, n, s, bs, vx, bx, vy, by, ny);
+}
+
+void GGML_TIER_FN(ggml_vec_dot_q6_K_q8_K_tile)(const int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny) {
+    ggml_vec_dot_k_q8_K_tile(GGML_TYPE_Q6_K, n, s, bs, vx, bx, vy, by, ny);
+}
+
+void GGML_TIER_FN(ggml_vec_dot_q4_Kx4_q8_K_tile)(const int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny) {
+    ggml_vec_dot_k_q8_K_tile(GGML_TYPE_Q4_K_X4, n, s, bs, vx, bx, vy, by, ny);
+}
+#endif
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "ggml.h"
+#include "ggml-impl.h"
 
 #include <stdint.h>
 #include <assert.h>
@@ -72,6 +72,16 @@ typedef struct {
     uint8_t qs[QK_K/2];        // 4--bit quants
 } block_q4_K;
 static_assert(sizeof(block_q4_K) == 2*sizeof(ggml_fp16_t) + K_SCALE_SIZE + QK_K/2, "wrong q4_K block size/padding");
+
+// super-block i of 4 rows of q4_K with the scales and mins unpacked to bytes
+typedef struct {
+    ggml_fp16_t d[4];           // super-block scales for quantized scales
+    ggml_fp16_t dmin[4];        // super-block scales for quantized mins
+    uint8_t scales[4][QK_K/32]; // scales, 6 bits
+    uint8_t mins[4][QK_K/32];   // mins, 6 bits
+    uint8_t qs[4][QK_K/2];      // 4--bit quants
+} block_q4_Kx4;
+static_assert(sizeof(block_q4_Kx4) == 4*(2*sizeof(ggml_fp16_t) + QK_K/16 + QK_K/2), "wrong q4_Kx4 block size/padding");
 #endif
 
 // 5-bit quantization
@@ -142,11 +152,23 @@ void dequantize_row_q6_K(const block_q6_K * restrict x, float * restrict y, int
 void dequantize_row_q8_K(const block_q8_K * restrict x, float * restrict y, int k);
 
 // Dot product
-void ggml_vec_dot_q2_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
-void ggml_vec_dot_q3_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
-void ggml_vec_dot_q4_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
-void ggml_vec_dot_q5_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
-void ggml_vec_dot_q6_K_q8_K(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q2_K_q8_K)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q3_K_q8_K)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q4_K_q8_K)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q5_K_q8_K)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+void GGML_TIER_FN(ggml_vec_dot_q6_K_q8_K)(int n, float * restrict s, const void * restrict vx, const void * restrict vy);
+
+#if QK_K == 256 && defined(__AVX2__)
+void GGML_TIER_FN(ggml_vec_dot_q4_K_q8_K_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q5_K_q8_K_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q6_K_q8_K_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+void GGML_TIER_FN(ggml_vec_dot_q4_Kx4_q8_K_tile)(int n, float * restrict s, size_t bs, const void * restrict vx, size_t bx, const void * restrict vy, size_t by, int ny);
+#endif
+
+#if QK_K == 256
+// Repacking of groups of 4 rows
+size_t ggml_repack_q4_K(const block_q4_K * restrict x, block_q4_Kx4 * restrict y, int nrows, int n_per_row);
+#endif
 
 // Quantization with histogram collection
 size_t ggml_quantize_q2_K(const float * src, void * dst, int n, int k, int64_t * hist);
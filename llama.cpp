@@ -10,6 +10,7 @@
 #include "llama.h"
 
 #include "ggml.h"
+#include "ggml-alloc.h"
 #ifdef GGML_USE_CUBLAS
 #include "ggml-cuda.h"
 #elif defined(GGML_USE_CLBLAST)
@@ -35,6 +36,7 @@
 #include <fstream>
 #include <random>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <queue>
 #include <cassert>
@@ -48,13 +50,21 @@
 #include <mutex>
 #include <sstream>
 #include <numeric>
+#include <sys/stat.h>
 
 #if defined(_MSC_VER)
 #pragma warning(disable: 4244 4267) // possible loss of data
 #endif
 
-#define LLAMA_USE_SCRATCH
-#define LLAMA_MAX_SCRATCH_BUFFERS 16
+// the attended KV cache range is rounded up to a multiple of this, so that consecutive
+// decode steps have the same graph shape and can reuse the same graph
+#define LLAMA_KV_CELLS_PAD 32
+
+// initial number of cells of the storage of the KV cache, a multiple of LLAMA_KV_CELLS_PAD
+#define LLAMA_KV_SIZE_INIT 256
+
+// alignment of the data of the graph tensors in buf_alloc
+#define LLAMA_TENSOR_ALIGNMENT 32
 
 // available llama models
 enum e_model {
@@ -68,67 +78,12 @@ enum e_model {
 
 static const size_t MB = 1024*1024;
 
-// computed for n_ctx == 2048
-// TODO: dynamically determine these sizes
-//       needs modifications in ggml
-
 typedef void (*offload_func_t)(struct ggml_tensor * tensor);
 
 void llama_nop(struct ggml_tensor * tensor) { // don't offload by default
     (void) tensor;
 }
 
-static const std::map<e_model, size_t> & MEM_REQ_SCRATCH0()
-{
-    static std::map<e_model, size_t> k_sizes = {
-        { MODEL_3B,    256ull * MB },
-        { MODEL_7B,    512ull * MB },
-        { MODEL_13B,   512ull * MB },
-        { MODEL_30B,   512ull * MB },
-        { MODEL_65B,  1024ull * MB },
-    };
-    return k_sizes;
-}
-
-static const std::map<e_model, size_t> & MEM_REQ_SCRATCH1()
-{
-    static std::map<e_model, size_t> k_sizes = {
-        { MODEL_3B,    256ull * MB },
-        { MODEL_7B,    512ull * MB },
-        { MODEL_13B,   512ull * MB },
-        { MODEL_30B,   512ull * MB },
-        { MODEL_65B,  1024ull * MB },
-    };
-    return k_sizes;
-}
-
-// 2*n_embd*n_ctx*n_layer*sizeof(float16)
-static const std::map<e_model, size_t> & MEM_REQ_KV_SELF()
-{
-    static std::map<e_model, size_t> k_sizes = {
-        { MODEL_3B,    682ull * MB },
-        { MODEL_7B,   1026ull * MB },
-        { MODEL_13B,  1608ull * MB },
-        { MODEL_30B,  3124ull * MB },
-        { MODEL_65B,  5120ull * MB },
-    };
-    return k_sizes;
-}
-
-// this is mostly needed for temporary mul_mat buffers to dequantize the data
-// not actually needed if BLAS is disabled
-static const std::map<e_model, size_t> & MEM_REQ_EVAL()
-{
-    static std::map<e_model, size_t> k_sizes = {
-        { MODEL_3B,   512ull * MB },
-        { MODEL_7B,   768ull * MB },
-        { MODEL_13B, 1024ull * MB },
-        { MODEL_30B, 1280ull * MB },
-        { MODEL_65B, 1536ull * MB },
-    };
-    return k_sizes;
-}
-
 // default hparams (LLaMA 7B)
 struct llama_hparams {
     uint32_t n_vocab = 32000;
@@ -154,6 +109,7 @@ struct llama_layer {
     struct ggml_tensor * wk;
     struct ggml_tensor * wv;
     struct ggml_tensor * wo;
+    struct ggml_tensor * wqkv = NULL; // the rows of wq, wk and wv with concat_weights
 
     // normalization
     struct ggml_tensor * ffn_norm;
@@ -162,17 +118,57 @@ struct llama_layer {
     struct ggml_tensor * w1;
     struct ggml_tensor * w2;
     struct ggml_tensor * w3;
+    struct ggml_tensor * w13 = NULL; // the rows of w1 and w3 with concat_weights
+};
+
+struct llama_kv_cell {
+    llama_pos pos   = -1;
+    llama_pos delta =  0; // position shift not yet applied to the cached K
+
+    std::set<llama_seq_id> seq_id;
+
+    bool is_empty() const {
+        return seq_id.empty();
+    }
+
+    bool has_seq_id(const llama_seq_id & id) const {
+        return seq_id.find(id) != seq_id.end();
+    }
 };
 
+// cells of the KV cache, each cell holds the K and V vectors of one token in every layer
+// and may be shared by several sequences
+//
+// the storage starts with LLAMA_KV_SIZE_INIT cells and doubles as the cache fills up, up to n_ctx cells
+// the sequences index their cells through the cell metadata, so a prompt prefix copied to another sequence
+// with llama_kv_cache_seq_cp is stored once, and a shared cell is only copied when one of its sequences shifts it
 struct llama_kv_cache {
-    struct ggml_tensor * k;
-    struct ggml_tensor * v;
+    struct ggml_tensor * k = NULL;
+    struct ggml_tensor * v = NULL;
 
     struct ggml_context * ctx = NULL;
 
     llama_ctx_buffer buf;
 
-    int n; // number of tokens currently in the cache
+    ggml_type type_k = GGML_TYPE_F16;
+    ggml_type type_v = GGML_TYPE_F16;
+
+    int n = 0; // number of cells used for attention, i.e. index of the last non-empty cell + 1
+
+    int size = 0; // number of cells with storage, the K and V tensors are [n_embd, size, n_layer]
+
+    bool growable = true; // the storage grows with the number of used cells
+
+    std::vector<llama_kv_cell> cells;
+
+    int head = 0; // first cell of the slot used by the current batch
+
+    bool has_shift = false; // some cells have a pending delta
+
+    // V is stored either transposed ([size, n_embd] per layer) so that KQV is a regular mul_mat,
+    // or like K ([n_embd, size] per layer) so that a cell is written as one contiguous row
+    // quantized V is always stored like K, since a cell can only be quantized one row at a time
+    bool v_trans = true;
 
     ~llama_kv_cache() {
         if (ctx) {
@@ -186,6 +182,43 @@ struct llama_kv_cache {
     }
 };
 
+// transformer graph of one batch shape, kept in llama_context for reuse by later evals
+struct llama_graph {
+    struct ggml_context * ctx = NULL;
+
+    struct ggml_cgraph gf = {};
+
+    // shape of the graph
+    int kv_size   = 0; // the KV cache views are built for this storage size
+    int n_tokens  = 0;
+    int n_kv      = 0;
+    int n_outputs = 0;
+    int n_threads = 0;
+
+    // inputs, written before each eval
+    struct ggml_tensor * inp_tokens  = NULL;
+    struct ggml_tensor * inp_pos     = NULL;
+    struct ggml_tensor * inp_KQ_mask = NULL;
+    struct ggml_tensor * inp_out_ids = NULL;
+
+    // per layer copies of the new K and V into the KV cache, rebound to the cells of each batch
+    std::vector<struct ggml_tensor *> k_cpy;
+    std::vector<struct ggml_tensor *> v_cpy;
+
+    // outputs
+    struct ggml_tensor * res        = NULL;
+    struct ggml_tensor * embeddings = NULL;
+
+    // size of buf_alloc used by the tensors of the graph
+    size_t alloc_size = 0;
+
+    ~llama_graph() {
+        if (ctx) {
+            ggml_free(ctx);
+        }
+    }
+};
+
 struct llama_vocab {
     using id    = int32_t;
     using token = std::string;
@@ -212,6 +245,9 @@ struct llama_model {
     std::vector<llama_layer> layers;
     int n_gpu_layers;
 
+    // no VRAM scratch buffer, the graph tensors stay on the CPU
+    bool low_vram = false;
+
     // context
     struct ggml_context * ctx = NULL;
 
@@ -221,9 +257,14 @@ struct llama_model {
     // model memory mapped file
     std::unique_ptr<llama_mmap> mapping;
 
+    // the repacked weights, memory mapped from the side file or repacked in memory
+    std::unique_ptr<llama_mmap>   mapping_repack;
+    std::unique_ptr<llama_buffer> buf_repack;
+
     // objects representing data potentially being locked in memory
     llama_mlock mlock_buf;
     llama_mlock mlock_mmap;
+    llama_mlock mlock_repack;
 
     // for quantize-stats only
     std::vector<std::pair<std::string, struct ggml_tensor *>> tensors_by_name;
@@ -254,6 +295,14 @@ struct llama_model {
 struct llama_context {
     llama_context(const llama_model & model, const llama_vocab & vocab) : model(model), vocab(vocab), t_load_us(model.t_load_us), t_start_us(model.t_start_us) {}
 
+    ~llama_context() {
+        ggml_threadpool_free(threadpool);
+
+        if (alloc) {
+            ggml_allocr_free(alloc);
+        }
+    }
+
     std::mt19937 rng;
 
     bool has_evaluated_once = false;
@@ -266,6 +315,14 @@ struct llama_context {
     int32_t n_eval   = 0; // number of eval calls
     int32_t n_p_eval = 0; // number of tokens in eval calls for the prompt (with batch size > 1)
 
+    int32_t n_graph_hit  = 0; // number of evals that reused the previous graph
+    int32_t n_graph_miss = 0; // number of evals that had to build a new graph
+
+    int64_t t_draft_us     = 0;
+    int32_t n_draft_step   = 0; // number of speculative decoding steps
+    int32_t n_draft_token  = 0; // number of draft tokens verified
+    int32_t n_draft_accept = 0; // number of draft tokens accepted
+
     const llama_model & model;
     const llama_vocab & vocab;
 
@@ -277,57 +334,60 @@ struct llama_context {
     // key + value cache for the self attention
     struct llama_kv_cache kv_self;
 
+    // worker threads used by ggml_graph_compute, kept alive between evals
+    struct ggml_threadpool * threadpool = NULL;
+
+    // cost model of the graphs of this context, measured on the host when calibrate is set
+    struct ggml_cost_model cost_model = ggml_cost_model_default();
+
+    // threads of the evals of a single token and of more tokens, 0 to use the n_threads of the eval call
+    // the decode of a single token is bound by the memory bandwidth and the larger batches by the compute
+    int n_threads       = 0;
+    int n_threads_batch = 0;
+
+    // threads of the last eval
+    int n_threads_eval = 0;
+
+    // graph of the last eval, its tensors are in buf_compute and their data in buf_alloc
+    llama_graph graph;
+
     size_t mem_per_token = 0;
 
-    // decode output (2-dimensional array: [n_tokens][n_vocab])
+    // decode output (2-dimensional array: [n_outputs][n_vocab])
     std::vector<float> logits;
     bool logits_all = false;
 
+    // attention through the fused GGML_OP_FLASH_ATTN_EXT instead of KQ, soft_max and KQV
+    bool flash_attn = false;
+
+    // row of logits for each token of the last batch, -1 if its logits were not computed
+    std::vector<int32_t> logits_rows;
+
+    // sequences of the batch and the positions of their cells, [n_seq][n_kv], used to fill the KQ mask
+    std::vector<llama_seq_id> mask_seq_ids;
+    std::vector<llama_pos>    mask_seq_pos;
+
     // input embedding (1-dimensional array: [n_embd])
     std::vector<float> embedding;
 
     // memory buffers used to evaluate the model
     // TODO: move in llama_state
-    llama_ctx_buffer buf_compute;
-    llama_ctx_buffer buf_scratch[LLAMA_MAX_SCRATCH_BUFFERS];
-
-#ifdef GGML_USE_METAL
-    ggml_metal_context * ctx_metal = NULL;
-#endif
-
-    int    buf_last = 0;
-    size_t buf_max_size[LLAMA_MAX_SCRATCH_BUFFERS] = { 0 };
+    llama_ctx_buffer buf_compute; // objects of the graph tensors
+    llama_ctx_buffer buf_alloc;   // data of the graph tensors, assigned by alloc
+    llama_ctx_buffer buf_work;    // work buffer of the graph computation
 
-    void use_buf(struct ggml_context * ctx, int i) {
-#if defined(LLAMA_USE_SCRATCH)
-        size_t last_size = 0;
-
-        if (i == -1) {
-            last_size = ggml_set_scratch(ctx, { 0, 0, nullptr, });
-        } else {
-            auto & buf = buf_scratch[i];
-            last_size = ggml_set_scratch(ctx, { 0, buf.size, buf.addr, });
-        }
+    // assigns the memory of buf_alloc to the tensors of each graph, reusing the memory of dead intermediates
+    struct ggml_allocr * alloc = NULL;
 
-        if (buf_last >= 0) {
-            buf_max_size[buf_last] = std::max(buf_max_size[buf_last], last_size);
-        }
+    // largest batch that buf_alloc is sized for
+    int n_tokens_reserved = 0;
 
-        buf_last = i;
-#else
-        (void) i;
-        (void) ctx;
-#endif
-    }
+#ifdef GGML_USE_METAL
+    ggml_metal_context * ctx_metal = NULL;
 
-    size_t get_buf_max_mem(int i) const {
-#if defined(LLAMA_USE_SCRATCH)
-        return buf_max_size[i];
-#else
-        (void) i;
-        return 0;
+    // address of buf_alloc when it was mapped to Metal
+    const uint8_t * metal_buf_alloc = NULL;
 #endif
-    }
 };
 
 template <typename T>
@@ -393,6 +453,14 @@ struct llama_load_tensor {
     struct ggml_tensor * ggml_tensor = NULL;
     uint8_t * data;
 
+    // the type of the interleaved rows if the tensor is repacked for the CPU, GGML_TYPE_COUNT otherwise
+    enum ggml_type repack_type = GGML_TYPE_COUNT;
+    size_t repack_size = 0;
+    size_t repack_offs = 0; // offset in the loader buffer of the repacked and the concatenated tensors
+
+    // the rows of the tensor follow those of the previous tensor of its group in the loader buffer (see concat_tensors)
+    bool concat = false;
+
     llama_load_tensor(const std::string & name) : name(name) {}
 
     void calc_all() {
@@ -658,15 +726,33 @@ struct llama_file_saver {
     }
 };
 
+// tensors multiplied by the same input, with their rows one after the other in the loader buffer
+// so that they can be multiplied as one matrix
+struct llama_concat_group {
+    std::string name;
+    std::vector<size_t> idx; // the tensors in tensors_map, in the order of their rows
+    struct ggml_tensor * ggml_tensor = NULL;
+};
+
 struct llama_model_loader {
     std::vector<std::unique_ptr<llama_file_loader>> file_loaders;
     llama_load_tensors_map tensors_map;
+    std::string fname_base;
     bool use_mmap;
     size_t num_ggml_tensors_created = 0;
     struct ggml_context * ggml_ctx = NULL;
     std::unique_ptr<llama_mmap> mapping;
 
-    llama_model_loader(const std::string & fname_base, bool use_mmap, bool vocab_only) {
+    // the repacked tensors are mapped from the side file if it matches the model, otherwise they are
+    // repacked in memory and the side file is written for the next loads
+    // the concatenated tensors live in the same buffer, they are copied on each load if no tensor is repacked
+    std::vector<llama_concat_group> concat_groups;
+    std::unique_ptr<llama_mmap>   mapping_repack;
+    std::unique_ptr<llama_buffer> buf_repack;
+    uint8_t * repack_addr = NULL;
+    size_t    repack_size = 0;
+
+    llama_model_loader(const std::string & fname_base, bool use_mmap, bool repack, bool vocab_only) : fname_base(fname_base) {
         auto * first_file = new llama_file_loader(fname_base.c_str(), 0, tensors_map);
         file_loaders.emplace_back(first_file);
         uint32_t n_parts = vocab_only ? 1 : guess_n_parts();
@@ -688,6 +774,14 @@ struct llama_model_loader {
         this->use_mmap = use_mmap;
         for (llama_load_tensor & lt : tensors_map.tensors) {
             lt.calc_all();
+
+            // the token embeddings are only used by ggml_get_rows
+            if (repack && lt.ne.size() == 2 && lt.ne.at(1) % 4 == 0 && lt.name != "tok_embeddings.weight") {
+                lt.repack_type = ggml_repack_type(lt.type);
+                if (lt.repack_type != GGML_TYPE_COUNT) {
+                    lt.repack_size = llama_calc_tensor_size(lt.ne, lt.repack_type);
+                }
+            }
         }
     }
 
@@ -715,8 +809,67 @@ struct llama_model_loader {
         *ctx_size_p = *mmapped_size_p = 0;
         for (const llama_load_tensor & lt : tensors_map.tensors) {
             *ctx_size_p += sizeof(struct ggml_tensor) + GGML_OBJECT_SIZE;
-            *(use_mmap ? mmapped_size_p : ctx_size_p) += lt.size;
+            if (lt.repack_type != GGML_TYPE_COUNT) {
+                *mmapped_size_p += lt.repack_size;
+            } else if (lt.concat) {
+                *mmapped_size_p += lt.size;
+            } else {
+                *(use_mmap ? mmapped_size_p : ctx_size_p) += lt.size;
+            }
+        }
+        *ctx_size_p += concat_groups.size()*(sizeof(struct ggml_tensor) + GGML_OBJECT_SIZE);
+    }
+
+    // size of the tensor in the loader buffer
+    static size_t buffer_size(const llama_load_tensor & lt) {
+        return lt.repack_type != GGML_TYPE_COUNT ? lt.repack_size : lt.size;
+    }
+
+    // concatenates the rows of the named 2D tensors in the loader buffer, the tensor of all the rows is returned
+    // by get_concat_tensor once they are created, the tensors that cannot be concatenated are loaded as usual
+    void concat_tensors(const std::string & name, const std::vector<std::string> & names) {
+        llama_concat_group group;
+        group.name = name;
+        for (const std::string & part : names) {
+            auto it = tensors_map.name_to_idx.find(part);
+            if (it == tensors_map.name_to_idx.end()) {
+                return;
+            }
+            const llama_load_tensor & lt = tensors_map.tensors.at(it->second);
+            const llama_load_tensor & first = tensors_map.tensors.at(group.idx.empty() ? it->second : group.idx.at(0));
+            if (lt.ne.size() != 2 || lt.concat || lt.type != first.type || lt.repack_type != first.repack_type ||
+                lt.ne.at(0) != first.ne.at(0)) {
+                return;
+            }
+            group.idx.push_back(it->second);
+        }
+        for (size_t idx : group.idx) {
+            tensors_map.tensors.at(idx).concat = true;
+        }
+        concat_groups.push_back(group);
+    }
+
+    // the tensor of the rows of a group of concat_tensors, NULL if there is no such group
+    struct ggml_tensor * get_concat_tensor(const std::string & name) {
+        for (llama_concat_group & group : concat_groups) {
+            if (group.name != name) {
+                continue;
+            }
+            const struct ggml_tensor * first = tensors_map.tensors.at(group.idx.at(0)).ggml_tensor;
+            int64_t n_rows = 0;
+            for (size_t idx : group.idx) {
+                const llama_load_tensor & lt = tensors_map.tensors.at(idx);
+                LLAMA_ASSERT(lt.ggml_tensor && lt.concat); // the tensors of the group have to be created on the CPU first
+                n_rows += lt.ggml_tensor->ne[1];
+            }
+            ggml_set_no_alloc(ggml_ctx, true);
+            group.ggml_tensor = ggml_new_tensor_2d(ggml_ctx, first->type, first->ne[0], n_rows);
+            ggml_set_no_alloc(ggml_ctx, use_mmap);
+            ggml_set_name(group.ggml_tensor, group.name.c_str());
+            group.ggml_tensor->backend = GGML_BACKEND_CPU;
+            return group.ggml_tensor;
         }
+        return NULL;
     }
 
     struct ggml_tensor * get_tensor(const std::string & name, const std::vector<uint32_t> & ne, ggml_backend backend) {
@@ -736,10 +889,17 @@ struct llama_model_loader {
     struct ggml_tensor * get_tensor_for(llama_load_tensor & lt, ggml_backend backend) {
         struct ggml_tensor * tensor;
         if (backend != GGML_BACKEND_CPU) {
+            // only the CPU kernels use the interleaved rows
+            lt.repack_type = GGML_TYPE_COUNT;
+            LLAMA_ASSERT(!lt.concat);
+        }
+        const bool repacked = lt.repack_type != GGML_TYPE_COUNT;
+        const bool in_buffer = repacked || lt.concat;
+        if (backend != GGML_BACKEND_CPU || in_buffer) {
             ggml_set_no_alloc(ggml_ctx, true);
         }
         if (lt.ne.size() == 2) {
-            tensor = ggml_new_tensor_2d(ggml_ctx, lt.type, lt.ne.at(0), lt.ne.at(1));
+            tensor = ggml_new_tensor_2d(ggml_ctx, repacked ? lt.repack_type : lt.type, lt.ne.at(0), lt.ne.at(1));
         } else {
             LLAMA_ASSERT(lt.ne.size() == 1);
             tensor = ggml_new_tensor_1d(ggml_ctx, lt.type, lt.ne.at(0));
@@ -747,7 +907,7 @@ struct llama_model_loader {
         ggml_set_name(tensor, lt.name.c_str());
         LLAMA_ASSERT(lt.ggml_tensor == NULL); // if this fails, we called get_tensor twice on the same tensor
 
-        if (backend != GGML_BACKEND_CPU) {
+        if (backend != GGML_BACKEND_CPU || in_buffer) {
             ggml_set_no_alloc(ggml_ctx, use_mmap);
         }
         tensor->backend = backend;
@@ -780,12 +940,45 @@ struct llama_model_loader {
             }
         }
 
+        const bool repack_cached = repack_begin();
+
         size_t done_size = 0;
         for (llama_load_tensor & lt : tensors_map.tensors) {
             if (progress_callback) {
                 progress_callback((float) done_size / data_size, progress_callback_user_data);
             }
             LLAMA_ASSERT(lt.ggml_tensor); // unused tensors should have been caught by load_data already
+
+            if (lt.repack_type != GGML_TYPE_COUNT) {
+                if (!repack_cached) {
+                    llama_buffer tmp_buf;
+                    if (!use_mmap) {
+                        tmp_buf.resize(lt.size);
+                        lt.data = tmp_buf.addr;
+                    }
+                    load_data_for(lt);
+                    ggml_repack(lt.type, lt.data, repack_addr + lt.repack_offs, lt.ne.at(1), lt.ne.at(0));
+                }
+                lt.ggml_tensor->data = repack_addr + lt.repack_offs;
+                done_size += lt.size;
+                continue;
+            }
+
+            if (lt.concat) {
+                if (!repack_cached) {
+                    if (use_mmap) {
+                        load_data_for(lt);
+                        memcpy(repack_addr + lt.repack_offs, lt.data, lt.size);
+                    } else {
+                        lt.data = repack_addr + lt.repack_offs;
+                        load_data_for(lt);
+                    }
+                }
+                lt.ggml_tensor->data = repack_addr + lt.repack_offs;
+                done_size += lt.size;
+                continue;
+            }
+
             lt.data = (uint8_t *) lt.ggml_tensor->data;
 
             // allocate temp buffer if not using mmap
@@ -826,6 +1019,150 @@ struct llama_model_loader {
 
             done_size += lt.size;
         }
+
+        for (llama_concat_group & group : concat_groups) {
+            if (group.ggml_tensor) {
+                group.ggml_tensor->data = repack_addr + tensors_map.tensors.at(group.idx.at(0)).repack_offs;
+            }
+        }
+
+        if (repack_size > 0 && !repack_cached && has_repacked()) {
+            repack_save();
+        }
+    }
+
+    bool has_repacked() const {
+        for (const llama_load_tensor & lt : tensors_map.tensors) {
+            if (lt.repack_type != GGML_TYPE_COUNT) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // side file with the repacked tensors, and the concatenated tensors if any:
+    //   header: magic, version, size and modification time of the model file, then the name, the types, the shape
+    //           and the offset of each tensor in the buffer
+    //   data:   the repacked tensors, from the header size rounded up to the page size
+    std::string repack_fname() const {
+        return fname_base + ".repack";
+    }
+
+    std::vector<uint8_t> repack_header() const {
+        std::vector<uint8_t> header;
+        auto append = [&header](const void * ptr, size_t len) {
+            header.insert(header.end(), (const uint8_t *) ptr, (const uint8_t *) ptr + len);
+        };
+        auto append_u32 = [&append](uint32_t val) { append(&val, sizeof(val)); };
+        auto append_u64 = [&append](uint64_t val) { append(&val, sizeof(val)); };
+
+        struct stat st = {};
+        stat(fname_base.c_str(), &st);
+
+        append_u32(LLAMA_REPACK_MAGIC);
+        append_u32(LLAMA_REPACK_VERSION);
+        append_u64(file_loaders.at(0)->file.size);
+        append_u64((uint64_t) st.st_mtime);
+        for (const llama_load_tensor & lt : tensors_map.tensors) {
+            if (lt.repack_type == GGML_TYPE_COUNT && !lt.concat) {
+                continue;
+            }
+            append_u32((uint32_t) lt.name.size());
+            append(lt.name.data(), lt.name.size());
+            append_u32(lt.type);
+            append_u32(lt.repack_type);
+            append_u32(lt.ne.at(0));
+            append_u32(lt.ne.at(1));
+            append_u64(lt.repack_offs);
+        }
+        return header;
+    }
+
+    static size_t repack_data_offs(size_t header_size) {
+        const size_t page_size = 4096;
+        return (header_size + page_size - 1) / page_size * page_size;
+    }
+
+    // lays out the repacked and the concatenated tensors and maps the side file if it matches,
+    // returns false if they have to be repacked or copied
+    bool repack_begin() {
+        repack_size = 0;
+        for (const llama_concat_group & group : concat_groups) {
+            // no padding between the tensors of a group, their rows are those of one matrix
+            for (size_t idx : group.idx) {
+                llama_load_tensor & lt = tensors_map.tensors.at(idx);
+                lt.repack_offs = repack_size;
+                repack_size += buffer_size(lt);
+            }
+            repack_size = (repack_size + 31) / 32 * 32;
+        }
+        for (llama_load_tensor & lt : tensors_map.tensors) {
+            if (lt.repack_type != GGML_TYPE_COUNT && !lt.concat) {
+                lt.repack_offs = repack_size;
+                repack_size += (lt.repack_size + 31) / 32 * 32;
+            }
+        }
+        if (repack_size == 0) {
+            return false;
+        }
+
+        if (!has_repacked()) {
+            // the concatenated tensors are only copies of the model data, they are not worth a side file
+            buf_repack.reset(new llama_buffer);
+            buf_repack->resize(repack_size);
+            repack_addr = buf_repack->addr;
+            return false;
+        }
+
+        const std::vector<uint8_t> header = repack_header();
+        const size_t data_offs = repack_data_offs(header.size());
+
+        try {
+            llama_file file(repack_fname().c_str(), "rb");
+            if (file.size == data_offs + repack_size) {
+                std::vector<uint8_t> file_header(header.size());
+                file.read_raw(file_header.data(), file_header.size());
+                if (file_header == header) {
+                    mapping_repack.reset(new llama_mmap(&file, file.size, ggml_is_numa()));
+                    repack_addr = (uint8_t *) mapping_repack->addr + data_offs;
+                    fprintf(stderr, "%s: using the repacked weights in %s\n", __func__, repack_fname().c_str());
+                    return true;
+                }
+            }
+            fprintf(stderr, "%s: %s does not match the model, repacking\n", __func__, repack_fname().c_str());
+        } catch (const std::exception &) {
+            // no side file yet
+        }
+
+        buf_repack.reset(new llama_buffer);
+        buf_repack->resize(repack_size);
+        repack_addr = buf_repack->addr;
+        return false;
+    }
+
+    // failing to write the side file is not an error, the weights are repacked again on the next load
+    void repack_save() const {
+        const std::string fname     = repack_fname();
+        const std::string fname_tmp = fname + ".tmp";
+
+        try {
+            const std::vector<uint8_t> header = repack_header();
+            const std::vector<uint8_t> padding(repack_data_offs(header.size()) - header.size(), 0);
+            {
+                llama_file file(fname_tmp.c_str(), "wb");
+                file.write_raw(header.data(), header.size());
+                file.write_raw(padding.data(), padding.size());
+                file.write_raw(repack_addr, repack_size);
+            }
+            std::remove(fname.c_str());
+            if (std::rename(fname_tmp.c_str(), fname.c_str()) != 0) {
+                throw std::runtime_error(format("failed to rename %s", fname_tmp.c_str()));
+            }
+            fprintf(stderr, "%s: saved the repacked weights to %s\n", __func__, fname.c_str());
+        } catch (const std::exception & err) {
+            std::remove(fname_tmp.c_str());
+            fprintf(stderr, "%s: warning: could not save the repacked weights: %s\n", __func__, err.what());
+        }
     }
 
     void load_data_for(llama_load_tensor & lt) {
@@ -891,20 +1228,145 @@ struct llama_model_loader {
 // kv cache
 //
 
-static bool kv_cache_init(
+// size in bytes of n consecutive elements of the given type, n must be a multiple of the block size
+static size_t llama_row_size(ggml_type type, int64_t n) {
+    return ggml_type_size(type)*n/ggml_blck_size(type);
+}
+
+// the quantized types are quantized along the head dimension and only supported by the CPU kernels
+static bool llama_kv_cache_type_supported(const struct llama_hparams & hparams, ggml_type type, int n_gpu_layers) {
+    switch (type) {
+        case GGML_TYPE_F32:
+        case GGML_TYPE_F16:
+            return true;
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q4_0:
+            break;
+        default:
+            return false;
+    }
+
+    // the quantized dot products with the heads take an even number of blocks
+    if ((hparams.n_embd/hparams.n_head) % (2*ggml_blck_size(type)) != 0) {
+        return false;
+    }
+
+    (void) n_gpu_layers;
+#if defined(GGML_USE_CUBLAS)
+    if (n_gpu_layers > (int) hparams.n_layer + 1) {
+        return false;
+    }
+#elif defined(GGML_USE_METAL)
+    if (n_gpu_layers > 0) {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+// size in bytes of the K and V data of n_cells cells
+static size_t llama_kv_cache_data_size(
+        const struct llama_hparams & hparams,
+       const struct llama_kv_cache & cache,
+                               int   n_cells) {
+    return (size_t) hparams.n_layer*n_cells*(llama_row_size(cache.type_k, hparams.n_embd) + llama_row_size(cache.type_v, hparams.n_embd));
+}
+
+// copy the K and V data of the cells [0, n_cells) to dst, all the K rows first, then all the V rows or columns
+static void llama_kv_cache_get_data(
+        const struct llama_hparams & hparams,
+       const struct llama_kv_cache & cache,
+                               int   n_cells,
+                           uint8_t * dst) {
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int size    = cache.size;
+
+    const size_t k_row_size = llama_row_size(cache.k->type, n_embd);
+    const size_t v_row_size = llama_row_size(cache.v->type, n_embd);
+    const size_t v_elt_size = ggml_element_size(cache.v);
+
+    for (int il = 0; il < n_layer; ++il) {
+        memcpy(dst, (char *) cache.k->data + k_row_size*il*size, k_row_size*n_cells);
+        dst += k_row_size*n_cells;
+    }
+
+    if (cache.v_trans) {
+        for (int il = 0; il < n_layer; ++il) {
+            for (int i = 0; i < n_embd; ++i) {
+                memcpy(dst, (char *) cache.v->data + v_elt_size*(il*n_embd + i)*size, v_elt_size*n_cells);
+                dst += v_elt_size*n_cells;
+            }
+        }
+    } else {
+        for (int il = 0; il < n_layer; ++il) {
+            memcpy(dst, (char *) cache.v->data + v_row_size*il*size, v_row_size*n_cells);
+            dst += v_row_size*n_cells;
+        }
+    }
+}
+
+// inverse of llama_kv_cache_get_data
+static void llama_kv_cache_set_data(
         const struct llama_hparams & hparams,
              struct llama_kv_cache & cache,
-                         ggml_type   wtype,
-                               int   n_ctx,
-                               int   n_gpu_layers) {
+                               int   n_cells,
+                     const uint8_t * src) {
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int size    = cache.size;
+
+    const size_t k_row_size = llama_row_size(cache.k->type, n_embd);
+    const size_t v_row_size = llama_row_size(cache.v->type, n_embd);
+    const size_t v_elt_size = ggml_element_size(cache.v);
+
+    for (int il = 0; il < n_layer; ++il) {
+        memcpy((char *) cache.k->data + k_row_size*il*size, src, k_row_size*n_cells);
+        src += k_row_size*n_cells;
+    }
+
+    if (cache.v_trans) {
+        for (int il = 0; il < n_layer; ++il) {
+            for (int i = 0; i < n_embd; ++i) {
+                memcpy((char *) cache.v->data + v_elt_size*(il*n_embd + i)*size, src, v_elt_size*n_cells);
+                src += v_elt_size*n_cells;
+            }
+        }
+    } else {
+        for (int il = 0; il < n_layer; ++il) {
+            memcpy((char *) cache.v->data + v_row_size*il*size, src, v_row_size*n_cells);
+            src += v_row_size*n_cells;
+        }
+    }
+}
+
+// (re)allocate the storage for size cells, keeping the data and metadata of the cells [0, cache.n)
+static bool llama_kv_cache_resize(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache,
+                               int   size) {
     const int n_embd  = hparams.n_embd;
     const int n_layer = hparams.n_layer;
 
-    const int64_t n_mem      = n_layer*n_ctx;
-    const int64_t n_elements = n_embd*n_mem;
+    LLAMA_ASSERT(size >= cache.n);
 
-    cache.buf.resize(2u*n_elements*ggml_type_size(wtype) + 2u*MB);
-    cache.n = 0;
+    // the layers are laid out one after the other, so the kept cells move - stash them while the buffer is replaced
+    const int n_keep = cache.ctx ? cache.n : 0;
+
+    std::vector<uint8_t> keep(llama_kv_cache_data_size(hparams, cache, n_keep));
+    if (n_keep > 0) {
+        llama_kv_cache_get_data(hparams, cache, n_keep, keep.data());
+    }
+
+    if (cache.ctx) {
+        ggml_free(cache.ctx);
+        cache.ctx = NULL;
+    }
+
+    const int64_t n_elements = (int64_t) n_embd*n_layer*size;
+
+    cache.buf.resize(llama_row_size(cache.type_k, n_elements) + llama_row_size(cache.type_v, n_elements) + 2u*MB);
 
     struct ggml_init_params params;
     params.mem_size   = cache.buf.size;
@@ -918,41 +1380,445 @@ static bool kv_cache_init(
         return false;
     }
 
-    cache.k = ggml_new_tensor_1d(cache.ctx, wtype, n_elements);
-    cache.v = ggml_new_tensor_1d(cache.ctx, wtype, n_elements);
+    cache.k = ggml_new_tensor_1d(cache.ctx, cache.type_k, n_elements);
+    cache.v = ggml_new_tensor_1d(cache.ctx, cache.type_v, n_elements);
     ggml_set_name(cache.k, "cache_k");
     ggml_set_name(cache.v, "cache_v");
 
-    (void) n_gpu_layers;
-#ifdef GGML_USE_CUBLAS
-    if (n_gpu_layers > n_layer + 1) {
-        ggml_cuda_assign_buffers_no_scratch(cache.v);
-    }
-    if (n_gpu_layers > n_layer + 2) {
-        ggml_cuda_assign_buffers_no_scratch(cache.k);
+    // empty cells inside the attended range are masked out, but must not contain NaNs
+    ggml_set_zero(cache.k);
+    ggml_set_zero(cache.v);
+
+    cache.size = size;
+    cache.cells.resize(size);
+
+    if (n_keep > 0) {
+        llama_kv_cache_set_data(hparams, cache, n_keep, keep.data());
     }
-#endif // GGML_USE_CUBLAS
 
     return true;
 }
 
-struct llama_context_params llama_context_default_params() {
-    struct llama_context_params result = {
-        /*.seed                        =*/ -1,
-        /*.n_ctx                       =*/ 512,
-        /*.n_batch                     =*/ 512,
-        /*.gpu_layers                  =*/ 0,
-        /*.main_gpu                    =*/ 0,
-        /*.tensor_split                =*/ {0},
-        /*.progress_callback           =*/ nullptr,
-        /*.progress_callback_user_data =*/ nullptr,
-        /*.low_vram                    =*/ false,
-        /*.f16_kv                      =*/ true,
-        /*.logits_all                  =*/ false,
-        /*.vocab_only                  =*/ false,
-        /*.use_mmap                    =*/ true,
-        /*.use_mlock                   =*/ false,
+// make sure that the storage holds at least n_cells cells
+// the storage at least doubles when it grows, so filling the cache one token at a time copies O(n_ctx) cells in total
+// instead of O(n_ctx^2) with a fixed increment - at the cost of up to twice the memory of the used cells, and of the
+// kept cells and the new storage at the same time while it grows
+// returns false if the cache cannot hold that many cells
+static bool llama_kv_cache_reserve(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache,
+                               int   n_cells) {
+    const int n_ctx = hparams.n_ctx;
+
+    if (n_cells <= cache.size) {
+        return true;
+    }
+
+    if (!cache.growable || n_cells > n_ctx) {
+        return false;
+    }
+
+    const int size = std::min(n_ctx, std::max(2*cache.size, ((n_cells + LLAMA_KV_CELLS_PAD - 1)/LLAMA_KV_CELLS_PAD)*LLAMA_KV_CELLS_PAD));
+
+    return llama_kv_cache_resize(hparams, cache, size);
+}
+
+static bool kv_cache_init(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache,
+                         ggml_type   type_k,
+                         ggml_type   type_v,
+                               int   n_ctx,
+                               int   n_gpu_layers,
+                              bool   v_rows) {
+    const int n_layer = hparams.n_layer;
+
+    // the GPU backends compute KQV with a mul_mat over the transposed V
+#if defined(GGML_USE_METAL)
+    if (n_gpu_layers > 0) {
+        v_rows = false;
+    }
+#elif defined(GGML_USE_CUBLAS)
+    if (n_gpu_layers > n_layer + 1) {
+        v_rows = false;
+    }
+#endif
+
+    cache.type_k  = type_k;
+    cache.type_v  = type_v;
+    cache.v_trans = !ggml_is_quantized(type_v) && !v_rows;
+    cache.n       = 0;
+    cache.size    = 0;
+
+    cache.cells.clear();
+
+    // the GPU backends map the buffer of the cache once, so it is allocated in full
+    cache.growable = true;
+    (void) n_layer;
+    (void) n_gpu_layers;
+#if defined(GGML_USE_METAL)
+    cache.growable = false;
+#elif defined(GGML_USE_CUBLAS)
+    cache.growable = n_gpu_layers <= n_layer + 1;
+#endif
+
+    if (!llama_kv_cache_resize(hparams, cache, cache.growable ? std::min(n_ctx, LLAMA_KV_SIZE_INIT) : n_ctx)) {
+        return false;
+    }
+
+#ifdef GGML_USE_CUBLAS
+    if (n_gpu_layers > n_layer + 1) {
+        ggml_cuda_assign_buffers_no_scratch(cache.v);
+    }
+    if (n_gpu_layers > n_layer + 2) {
+        ggml_cuda_assign_buffers_no_scratch(cache.k);
+    }
+#endif // GGML_USE_CUBLAS
+
+    return true;
+}
+
+static void llama_kv_cache_update_n(struct llama_kv_cache & cache) {
+    int n = (int) cache.cells.size();
+    while (n > 0 && cache.cells[n - 1].is_empty()) {
+        n--;
+    }
+    cache.n = n;
+}
+
+// find a contiguous range of empty cells for the tokens of the batch and assign them
+// the cells are taken first-fit, so a single sequence evaluated in order fills the cache linearly
+static bool llama_kv_cache_find_slot(
+           struct llama_kv_cache & cache,
+        const struct llama_batch & batch) {
+    const int n_ctx    = (int) cache.cells.size();
+    const int n_tokens = batch.n_tokens;
+
+    if (n_tokens > n_ctx) {
+        return false;
+    }
+
+    int head = 0;
+
+    while (true) {
+        if (head + n_tokens > n_ctx) {
+            return false;
+        }
+
+        bool found = true;
+        for (int i = 0; i < n_tokens; i++) {
+            if (!cache.cells[head + i].is_empty()) {
+                found = false;
+                head += i + 1;
+                break;
+            }
+        }
+
+        if (found) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < n_tokens; i++) {
+        cache.cells[head + i].pos = batch.pos[i];
+        cache.cells[head + i].seq_id.insert(batch.seq_id[i]);
+    }
+
+    cache.head = head;
+
+    llama_kv_cache_update_n(cache);
+
+    return true;
+}
+
+// release the cells claimed by llama_kv_cache_find_slot for a batch that failed to evaluate
+static void llama_kv_cache_free_slot(
+           struct llama_kv_cache & cache,
+        const struct llama_batch & batch) {
+    for (int i = 0; i < batch.n_tokens; i++) {
+        auto & cell = cache.cells[cache.head + i];
+
+        cell.seq_id.clear();
+        cell.pos   = -1;
+        cell.delta =  0;
+    }
+
+    llama_kv_cache_update_n(cache);
+}
+
+static void llama_kv_cache_seq_rm(
+        struct llama_kv_cache & cache,
+                 llama_seq_id   seq_id,
+                    llama_pos   p0,
+                    llama_pos   p1) {
+    if (p0 < 0) p0 = 0;
+    if (p1 < 0) p1 = INT_MAX;
+
+    for (auto & cell : cache.cells) {
+        if (cell.has_seq_id(seq_id) && cell.pos >= p0 && cell.pos < p1) {
+            cell.seq_id.erase(seq_id);
+            if (cell.is_empty()) {
+                cell.pos   = -1;
+                cell.delta =  0;
+            }
+        }
+    }
+
+    llama_kv_cache_update_n(cache);
+}
+
+// copy the K and V data of the cell src to the cell dst
+static void llama_kv_cache_copy_cell(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache,
+                               int   dst,
+                               int   src) {
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int size    = cache.size;
+
+    // size of the data of one cell in a K row / V column
+    const size_t k_size = llama_row_size(cache.k->type, n_embd);
+    const size_t v_size = cache.v_trans ? ggml_element_size(cache.v) : llama_row_size(cache.v->type, n_embd);
+
+    char * k_data = (char *) cache.k->data;
+    char * v_data = (char *) cache.v->data;
+
+    for (int il = 0; il < n_layer; ++il) {
+        memcpy(k_data + k_size*(il*size + dst), k_data + k_size*(il*size + src), k_size);
+
+        if (cache.v_trans) {
+            for (int i = 0; i < n_embd; ++i) {
+                memcpy(v_data + v_size*((il*n_embd + i)*size + dst), v_data + v_size*((il*n_embd + i)*size + src), v_size);
+            }
+        } else {
+            memcpy(v_data + v_size*(il*size + dst), v_data + v_size*(il*size + src), v_size);
+        }
+    }
+}
+
+// index of an empty cell, growing the cache if there is none, -1 if the cache is full
+static int llama_kv_cache_find_free_cell(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache) {
+    for (int i = 0; i < cache.size; ++i) {
+        if (cache.cells[i].is_empty()) {
+            return i;
+        }
+    }
+
+    const int i = cache.size;
+
+    if (!llama_kv_cache_reserve(hparams, cache, cache.size + 1)) {
+        return -1;
+    }
+
+    return i;
+}
+
+static void llama_kv_cache_seq_shift(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache,
+                      llama_seq_id   seq_id,
+                         llama_pos   p0,
+                         llama_pos   p1,
+                         llama_pos   delta) {
+    if (p0 < 0) p0 = 0;
+    if (p1 < 0) p1 = INT_MAX;
+
+    // collect the cells first, the copies made below must not be shifted again
+    std::vector<int> ids;
+    for (int i = 0; i < cache.size; ++i) {
+        const llama_kv_cell & cell = cache.cells[i];
+        if (cell.has_seq_id(seq_id) && cell.pos >= p0 && cell.pos < p1) {
+            ids.push_back(i);
+        }
+    }
+
+    for (int i : ids) {
+        if (cache.cells[i].seq_id.size() > 1) {
+            // the cell is shared with other sequences, which keep it as it is
+            cache.cells[i].seq_id.erase(seq_id);
+
+            if (cache.cells[i].pos + delta < 0) {
+                continue;
+            }
+
+            // copy-on-write: the shifted sequence gets its own copy of the cell
+            const int j = llama_kv_cache_find_free_cell(hparams, cache);
+            if (j < 0) {
+                fprintf(stderr, "%s: no free KV cache cell to copy a shared cell to, dropping pos %d of sequence %d\n",
+                        __func__, cache.cells[i].pos, seq_id);
+                continue;
+            }
+
+            llama_kv_cache_copy_cell(hparams, cache, j, i);
+
+            cache.cells[j].pos   = cache.cells[i].pos;
+            cache.cells[j].delta = cache.cells[i].delta;
+            cache.cells[j].seq_id.insert(seq_id);
+
+            // the cells past cache.n are not kept when the cache grows
+            llama_kv_cache_update_n(cache);
+
+            i = j;
+        }
+
+        llama_kv_cell & cell = cache.cells[i];
+
+        cell.pos += delta;
+
+        if (cell.pos < 0) {
+            // shifted before the start of the sequence
+            cell.seq_id.clear();
+            cell.pos   = -1;
+            cell.delta =  0;
+        } else {
+            cell.delta += delta;
+            cache.has_shift = true;
+        }
+    }
+
+    llama_kv_cache_update_n(cache);
+}
+
+// move the used cells to the front of the cache, keeping their order, so that the free cells form one range
+// the cells are moved in runs, K rows and V rows or columns of a run are contiguous in every layer
+static void llama_kv_cache_defrag(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache) {
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int n_ctx   = (int) cache.cells.size();
+
+    // size of the data of one cell in a K row / V column
+    const size_t k_size = llama_row_size(cache.k->type, n_embd);
+    const size_t v_size = cache.v_trans ? ggml_element_size(cache.v) : llama_row_size(cache.v->type, n_embd);
+
+    char * k_data = (char *) cache.k->data;
+    char * v_data = (char *) cache.v->data;
+
+    int dst = 0;
+    int src = 0;
+
+    while (src < n_ctx) {
+        if (cache.cells[src].is_empty()) {
+            src++;
+            continue;
+        }
+
+        int n_run = 1;
+        while (src + n_run < n_ctx && !cache.cells[src + n_run].is_empty()) {
+            n_run++;
+        }
+
+        if (dst != src) {
+            for (int il = 0; il < n_layer; ++il) {
+                memmove(k_data + k_size*(il*n_ctx + dst),
+                        k_data + k_size*(il*n_ctx + src), k_size*n_run);
+
+                if (cache.v_trans) {
+                    for (int i = 0; i < n_embd; ++i) {
+                        memmove(v_data + v_size*((il*n_embd + i)*n_ctx + dst),
+                                v_data + v_size*((il*n_embd + i)*n_ctx + src), v_size*n_run);
+                    }
+                } else {
+                    memmove(v_data + v_size*(il*n_ctx + dst),
+                            v_data + v_size*(il*n_ctx + src), v_size*n_run);
+                }
+            }
+
+            for (int i = 0; i < n_run; ++i) {
+                cache.cells[dst + i] = cache.cells[src + i];
+
+                cache.cells[src + i].seq_id.clear();
+                cache.cells[src + i].pos   = -1;
+                cache.cells[src + i].delta =  0;
+            }
+        }
+
+        dst += n_run;
+        src += n_run;
+    }
+
+    llama_kv_cache_update_n(cache);
+}
+
+// give back the storage of the cells that are no longer used: once at most a quarter of the storage holds used cells,
+// these are compacted and the storage is reduced to twice their number - growing doubles the storage, so a cache that
+// fills and empties around one size is not reallocated on every call
+// returns false if the smaller storage could not be allocated
+static bool llama_kv_cache_shrink(
+        const struct llama_hparams & hparams,
+             struct llama_kv_cache & cache) {
+    const int n_ctx = hparams.n_ctx;
+
+    if (!cache.growable) {
+        return true;
+    }
+
+    int n_used = 0;
+    for (const auto & cell : cache.cells) {
+        n_used += cell.is_empty() ? 0 : 1;
+    }
+
+    const int size = std::min(n_ctx, std::max(LLAMA_KV_SIZE_INIT, ((2*n_used + LLAMA_KV_CELLS_PAD - 1)/LLAMA_KV_CELLS_PAD)*LLAMA_KV_CELLS_PAD));
+
+    if (4*n_used > cache.size || size >= cache.size) {
+        return true;
+    }
+
+    if (cache.n > size) {
+        llama_kv_cache_defrag(hparams, cache);
+    }
+
+    return llama_kv_cache_resize(hparams, cache, size);
+}
+
+// the cells are shared, not copied: the new tokens of both sequences go to new cells, and the only write to the data
+// of an existing cell - the rotation of llama_kv_cache_seq_shift - copies a shared cell first (copy-on-write)
+static void llama_kv_cache_seq_cp(
+        struct llama_kv_cache & cache,
+                 llama_seq_id   seq_id_src,
+                 llama_seq_id   seq_id_dst,
+                    llama_pos   p0,
+                    llama_pos   p1) {
+    if (p0 < 0) p0 = 0;
+    if (p1 < 0) p1 = INT_MAX;
+
+    for (auto & cell : cache.cells) {
+        if (cell.has_seq_id(seq_id_src) && cell.pos >= p0 && cell.pos < p1) {
+            cell.seq_id.insert(seq_id_dst);
+        }
+    }
+}
+
+struct llama_context_params llama_context_default_params() {
+    struct llama_context_params result = {
+        /*.seed                        =*/ -1,
+        /*.n_ctx                       =*/ 512,
+        /*.n_batch                     =*/ 512,
+        /*.n_threads                   =*/ 0,
+        /*.n_threads_batch             =*/ 0,
+        /*.gpu_layers                  =*/ 0,
+        /*.main_gpu                    =*/ 0,
+        /*.tensor_split                =*/ {0},
+        /*.progress_callback           =*/ nullptr,
+        /*.progress_callback_user_data =*/ nullptr,
+        /*.type_k                      =*/ GGML_TYPE_F16,
+        /*.type_v                      =*/ GGML_TYPE_F16,
+        /*.low_vram                    =*/ false,
+        /*.f16_kv                      =*/ true,
+        /*.logits_all                  =*/ false,
+        /*.vocab_only                  =*/ false,
+        /*.use_mmap                    =*/ true,
+        /*.use_mlock                   =*/ false,
         /*.embedding                   =*/ false,
+        /*.flash_attn                  =*/ true,
+        /*.repack                      =*/ false,
+        /*.concat_weights              =*/ false,
+        /*.v_rows                      =*/ true,
+        /*.calibrate                   =*/ false,
     };
 
     return result;
@@ -1058,20 +1924,36 @@ static void llama_model_load_internal(
         int main_gpu,
         const float * tensor_split,
         bool low_vram,
-        ggml_type memory_type,
+        ggml_type type_k,
+        ggml_type type_v,
         bool use_mmap,
         bool use_mlock,
+        bool repack,
+        bool concat_weights,
         bool vocab_only,
         llama_progress_callback progress_callback,
         void * progress_callback_user_data) {
 
     model.t_start_us = ggml_time_us();
 
-    std::unique_ptr<llama_model_loader> ml(new llama_model_loader(fname, use_mmap, vocab_only));
+#if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST) || defined(GGML_USE_METAL)
+    // the GPU backends multiply the CPU tensors too and do not support the interleaved rows
+    if (repack) {
+        fprintf(stderr, "%s: repacking the weights is not supported with GPU acceleration\n", __func__);
+        repack = false;
+    }
+    if (concat_weights) {
+        fprintf(stderr, "%s: concatenating the weights is not supported with GPU acceleration\n", __func__);
+        concat_weights = false;
+    }
+#endif
+
+    std::unique_ptr<llama_model_loader> ml(new llama_model_loader(fname, use_mmap, repack, vocab_only));
 
     vocab = std::move(ml->file_loaders.at(0)->vocab);
     model.hparams = ml->file_loaders.at(0)->hparams;
     model.n_gpu_layers = n_gpu_layers;
+    model.low_vram     = low_vram;
     llama_file_version file_version = ml->file_loaders.at(0)->file_version;
     auto & hparams = model.hparams;
 
@@ -1130,6 +2012,18 @@ static void llama_model_load_internal(
         return;
     }
 
+    // wq, wk, wv and w1, w3 multiply the same input, each group is multiplied as one matrix (see llama_eval_internal)
+    if (concat_weights) {
+        for (uint32_t i = 0; i < hparams.n_layer; ++i) {
+            const std::string layers_i = "layers." + std::to_string(i);
+
+            ml->concat_tensors(layers_i + ".attention.wqkv.weight",
+                    { layers_i + ".attention.wq.weight", layers_i + ".attention.wk.weight", layers_i + ".attention.wv.weight" });
+            ml->concat_tensors(layers_i + ".feed_forward.w13.weight",
+                    { layers_i + ".feed_forward.w1.weight", layers_i + ".feed_forward.w3.weight" });
+        }
+    }
+
     auto & ctx = model.ctx;
 
     size_t ctx_size;
@@ -1174,7 +2068,6 @@ static void llama_model_load_internal(
 
     // prepare memory for the weights
     size_t vram_weights = 0;
-    size_t vram_scratch = 0;
     {
         const uint32_t n_embd  = hparams.n_embd;
         const uint32_t n_layer = hparams.n_layer;
@@ -1230,12 +2123,14 @@ static void llama_model_load_internal(
             layer.wk = ml->get_tensor(layers_i + ".attention.wk.weight", {n_embd, n_embd}, backend_split);
             layer.wv = ml->get_tensor(layers_i + ".attention.wv.weight", {n_embd, n_embd}, backend_split);
             layer.wo = ml->get_tensor(layers_i + ".attention.wo.weight", {n_embd, n_embd}, backend_split);
+            layer.wqkv = ml->get_concat_tensor(layers_i + ".attention.wqkv.weight");
 
             layer.ffn_norm = ml->get_tensor(layers_i + ".ffn_norm.weight", {n_embd}, backend);
 
             layer.w1 = ml->get_tensor(layers_i + ".feed_forward.w1.weight", {n_embd,   n_ff},   backend_split);
             layer.w2 = ml->get_tensor(layers_i + ".feed_forward.w2.weight", {  n_ff,   n_embd}, backend_split);
             layer.w3 = ml->get_tensor(layers_i + ".feed_forward.w3.weight", {n_embd,   n_ff},   backend_split);
+            layer.w13 = ml->get_concat_tensor(layers_i + ".feed_forward.w13.weight");
 
             if (backend == GGML_BACKEND_GPU) {
                 vram_weights +=
@@ -1248,38 +2143,29 @@ static void llama_model_load_internal(
 
     ml->done_getting_tensors();
 
+    // the K and the V cache of a full context
+    const size_t kv_size_k = (size_t) hparams.n_layer*hparams.n_ctx*llama_row_size(type_k, hparams.n_embd);
+    const size_t kv_size_v = (size_t) hparams.n_layer*hparams.n_ctx*llama_row_size(type_v, hparams.n_embd);
+
     // print memory requirements
     {
-        const size_t scale = memory_type == GGML_TYPE_F32 ? 2 : 1;
-
-        // this is the total memory required to run the inference
+        // this is the memory required by the weights, the compute buffers are sized when a context is created
         const size_t mem_required =
             ctx_size +
-            mmapped_size - vram_weights + // weights in VRAM not in memory
-            MEM_REQ_SCRATCH0().at(model.type) +
-            MEM_REQ_SCRATCH1().at(model.type) +
-            MEM_REQ_EVAL().at    (model.type);
+            mmapped_size - vram_weights; // weights in VRAM not in memory
 
         // this is the memory required by one llama_state
-        const size_t mem_required_state =
-            scale*MEM_REQ_KV_SELF().at(model.type);
+        const size_t mem_required_state = kv_size_k + kv_size_v;
 
         fprintf(stderr, "%s: mem required  = %7.2f MB (+ %7.2f MB per state)\n", __func__,
                 mem_required / 1024.0 / 1024.0, mem_required_state / 1024.0 / 1024.0);
 
-        (void) vram_scratch;
         (void) n_batch;
 #ifdef GGML_USE_CUBLAS
+        // the VRAM scratch buffer mirrors the compute buffer, it is sized with it when a context is created
         if (low_vram) {
             fprintf(stderr, "%s: not allocating a VRAM scratch buffer due to low VRAM option\n", __func__);
             ggml_cuda_set_scratch_size(0); // disable scratch
-        } else {
-            vram_scratch = n_batch * MB;
-            ggml_cuda_set_scratch_size(vram_scratch);
-            if (n_gpu_layers > 0) {
-                fprintf(stderr, "%s: allocating batch_size x 1 MB = %zd MB VRAM for the scratch buffer\n",
-                        __func__, vram_scratch / MB);
-            }
         }
 #endif // GGML_USE_CUBLAS
 #if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST)
@@ -1295,7 +2181,7 @@ static void llama_model_load_internal(
                 fprintf(stderr, "%s: cannot offload v cache to GPU due to low VRAM option\n", __func__);
             } else {
                 fprintf(stderr, "%s: offloading v cache to GPU\n", __func__);
-                vram_kv_cache += MEM_REQ_KV_SELF().at(model.type) / 2;
+                vram_kv_cache += kv_size_v;
             }
         }
         if (n_gpu_layers > (int) hparams.n_layer + 2) {
@@ -1303,14 +2189,14 @@ static void llama_model_load_internal(
                 fprintf(stderr, "%s: cannot offload k cache to GPU due to low VRAM option\n", __func__);
             } else {
                 fprintf(stderr, "%s: offloading k cache to GPU\n", __func__);
-                vram_kv_cache += MEM_REQ_KV_SELF().at(model.type) / 2;
+                vram_kv_cache += kv_size_k;
             }
         }
         const int max_offloadable_layers = low_vram ? hparams.n_layer + 1 : hparams.n_layer + 3;
         fprintf(stderr, "%s: offloaded %d/%d layers to GPU\n",
                 __func__, std::min(n_gpu_layers, max_offloadable_layers), hparams.n_layer + 3);
-        fprintf(stderr, "%s: total VRAM used: %zu MB\n",
-                __func__, (vram_weights + vram_scratch + vram_kv_cache + MB - 1) / MB); // round up
+        fprintf(stderr, "%s: total VRAM used: %zu MB (+ the scratch buffer)\n",
+                __func__, (vram_weights + vram_kv_cache + MB - 1) / MB); // round up
 #else
         (void) n_gpu_layers;
 #endif
@@ -1336,6 +2222,13 @@ static void llama_model_load_internal(
 
     model.mapping = std::move(ml->mapping);
 
+    model.mapping_repack = std::move(ml->mapping_repack);
+    model.buf_repack     = std::move(ml->buf_repack);
+    if (use_mlock && ml->repack_size > 0) {
+        model.mlock_repack.init(ml->repack_addr);
+        model.mlock_repack.grow_to(ml->repack_size);
+    }
+
     // loading time will be recalculate after the first eval, so
     // we take page faults deferred by mmap() into consideration
     model.t_load_us = ggml_time_us() - model.t_start_us;
@@ -1351,15 +2244,18 @@ static bool llama_model_load(
         int main_gpu,
         float * tensor_split,
         bool low_vram,
-        ggml_type memory_type,
+        ggml_type type_k,
+        ggml_type type_v,
         bool use_mmap,
         bool use_mlock,
+        bool repack,
+        bool concat_weights,
         bool vocab_only,
         llama_progress_callback progress_callback,
         void *progress_callback_user_data) {
     try {
-        llama_model_load_internal(fname, model, vocab, n_ctx, n_batch, n_gpu_layers, main_gpu, tensor_split, low_vram, memory_type,
-                                  use_mmap, use_mlock, vocab_only, progress_callback, progress_callback_user_data);
+        llama_model_load_internal(fname, model, vocab, n_ctx, n_batch, n_gpu_layers, main_gpu, tensor_split, low_vram, type_k, type_v,
+                                  use_mmap, use_mlock, repack, concat_weights, vocab_only, progress_callback, progress_callback_user_data);
         return true;
     } catch (const std::exception & err) {
         fprintf(stderr, "error loading model: %s\n", err.what());
@@ -1367,66 +2263,211 @@ static bool llama_model_load(
     }
 }
 
-// evaluate the transformer
-//
-//   - lctx:         llama context
-//   - tokens:       new batch of tokens to process
-//   - n_past:       the context size so far
-//   - n_threads:    number of threads to use
-//   - cgraph_fname: filename of the exported computation graph
-//
-static bool llama_eval_internal(
-        llama_context &  lctx,
-    const llama_token *  tokens,
-            const int    n_tokens,
-            const int    n_past,
-            const int    n_threads,
-            const char * cgraph_fname) {
+#ifdef GGML_USE_METAL
+// whether the whole graph of the eval is computed with Metal - the decode of a single token
+// buf_alloc is mapped once when the context is created, after a larger batch reallocates it the graphs run on the CPU
+static bool llama_metal_graph(const llama_context & lctx, int N) {
+    return lctx.ctx_metal && N == 1 && lctx.buf_alloc.addr == lctx.metal_buf_alloc;
+}
+#endif
 
-    // enforce that the first token is BOS
-    if (n_past == 0 && tokens[0] != llama_token_bos()) {
-        fprintf(stderr, "%s: first token must be BOS\n", __func__);
-        return false;
+static void llama_graph_compute(llama_context & lctx, struct ggml_context * ctx, struct ggml_cgraph * graph) {
+    // the pool is (re)created only when more threads are requested than it has
+    if (graph->n_threads > 1 && (lctx.threadpool == NULL || ggml_threadpool_n_threads(lctx.threadpool) < graph->n_threads)) {
+        ggml_threadpool_free(lctx.threadpool);
+        lctx.threadpool = ggml_threadpool_new(graph->n_threads);
     }
 
-    const int64_t t_start_us = ggml_time_us();
+    graph->cost_model = &lctx.cost_model;
+
+    ggml_graph_compute_pool(ctx, graph, lctx.threadpool);
+}
+
+// re-rotate the cached K of the shifted cells to their new positions
+// RoPE rotations compose, so rotating a RoPE-ed key by delta gives the key at position pos + delta
+static void llama_kv_cache_apply_shift(llama_context & lctx, int n_threads) {
+    auto & kv_self = lctx.kv_self;
+
+    if (!kv_self.has_shift) {
+        return;
+    }
+
+    const auto & hparams = lctx.model.hparams;
+
+    const int n_embd  = hparams.n_embd;
+    const int n_layer = hparams.n_layer;
+    const int kv_size = kv_self.size;
+    const int n_head  = hparams.n_head;
+    const int n_rot   = hparams.n_embd/hparams.n_head;
+    const int n_kv    = kv_self.n;
+
+    // a quantized K is rotated in F32 and quantized back
+    const bool k_quant = ggml_is_quantized(kv_self.k->type);
+
+    if (n_kv > 0) {
+        std::vector<uint8_t> buf(ggml_tensor_overhead()*(8*n_layer + 8) + n_kv*sizeof(int32_t) + 64*n_layer + 1024 +
+                (k_quant ? n_embd*n_kv*sizeof(float) : 0));
+
+        struct ggml_init_params params = {
+            /*.mem_size   =*/ buf.size(),
+            /*.mem_buffer =*/ buf.data(),
+            /*.no_alloc   =*/ false,
+        };
+
+        struct ggml_context * ctx0 = ggml_init(params);
 
-    const int N = n_tokens;
+        ggml_cgraph gf = {};
+        gf.n_threads = n_threads;
 
+        struct ggml_tensor * K_shift = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, n_kv);
+        ggml_set_name(K_shift, "K_shift");
+
+        int32_t * data = (int32_t *) K_shift->data;
+        for (int i = 0; i < n_kv; ++i) {
+            data[i] = kv_self.cells[i].delta;
+        }
+
+        // the layers are processed one after the other, so they can share the F32 copy
+        struct ggml_tensor * K_f32 = k_quant ? ggml_new_tensor_3d(ctx0, GGML_TYPE_F32, n_embd/n_head, n_head, n_kv) : NULL;
+
+        for (int il = 0; il < n_layer; ++il) {
+            struct ggml_tensor * k =
+                ggml_view_3d(ctx0, kv_self.k,
+                        n_embd/n_head, n_head, n_kv,
+                        llama_row_size(kv_self.k->type, n_embd/n_head),
+                        llama_row_size(kv_self.k->type, n_embd),
+                        llama_row_size(kv_self.k->type, n_embd)*kv_size*il);
+
+            if (k_quant) {
+                struct ggml_tensor * tmp = ggml_rope_pos_inplace(ctx0, ggml_cpy(ctx0, k, K_f32), K_shift, n_rot, 0, 0);
+                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, tmp, k));
+            } else {
+                ggml_build_forward_expand(&gf, ggml_rope_pos_inplace(ctx0, k, K_shift, n_rot, 0, 0));
+            }
+        }
+
+#ifdef GGML_USE_CUBLAS
+        // an offloaded K is rotated on the CPU - the shifts are rare, so the cache is copied to the host and back
+        const bool k_gpu = kv_self.k->backend == GGML_BACKEND_GPU;
+        if (k_gpu) {
+            ggml_cuda_copy_to_host(kv_self.k);
+        }
+#endif // GGML_USE_CUBLAS
+
+        llama_graph_compute(lctx, ctx0, &gf);
+
+#ifdef GGML_USE_CUBLAS
+        if (k_gpu) {
+            ggml_cuda_copy_to_device(kv_self.k);
+        }
+#endif // GGML_USE_CUBLAS
+
+        ggml_free(ctx0);
+    }
+
+    for (auto & cell : kv_self.cells) {
+        cell.delta = 0;
+    }
+
+    kv_self.has_shift = false;
+}
+
+// build the transformer graph into lctx.graph
+//
+//   - lctx:         llama context
+//   - N:            number of tokens in the batch
+//   - n_kv:         number of KV cache cells attended to
+//   - kv_head:      first KV cache cell receiving the new tokens
+//   - n_outputs:    number of tokens whose logits are computed
+//   - n_threads:    number of threads to use
+//
+// the input tensors are allocated but not set
+//
+static void llama_build_graph(
+        llama_context & lctx,
+            const int   N,
+            const int   n_kv,
+            const int   kv_head,
+            const int   n_outputs,
+            const int   n_threads) {
     const auto & model   = lctx.model;
     const auto & hparams = model.hparams;
 
     const auto & kv_self = lctx.kv_self;
 
-    LLAMA_ASSERT(!!kv_self.ctx);
-
     const int n_embd       = hparams.n_embd;
     const int n_layer      = hparams.n_layer;
-    const int n_ctx        = hparams.n_ctx;
+    const int kv_size      = kv_self.size;
     const int n_head       = hparams.n_head;
-    const int n_vocab      = hparams.n_vocab;
     const int n_rot        = hparams.n_embd/hparams.n_head;
     const int n_gpu_layers = model.n_gpu_layers;
 
-    auto & mem_per_token = lctx.mem_per_token;
-    auto & buf_compute   = lctx.buf_compute;
+    auto & buf_compute = lctx.buf_compute;
+    auto & graph       = lctx.graph;
+    auto & alloc       = lctx.alloc;
+
+    // the previous graph lives in the same buffers
+    if (graph.ctx) {
+        ggml_free(graph.ctx);
+    }
+
+    ggml_allocr_reset(alloc);
 
+    // the data of the tensors is assigned by the allocator once the graph is built
     struct ggml_init_params params = {
         /*.mem_size   =*/ buf_compute.size,
         /*.mem_buffer =*/ buf_compute.addr,
-        /*.no_alloc   =*/ false,
+        /*.no_alloc   =*/ true,
     };
 
     struct ggml_context * ctx0 = ggml_init(params);
 
-    // for big prompts, if BLAS is enabled, it is better to use only one thread
-    // otherwise, the threads are spin-lock waiting for the BLAS calls and are degrading the performance
-    ggml_cgraph gf = {};
-    gf.n_threads = N >= 32 && ggml_cpu_has_blas() && !ggml_cpu_has_gpublas() ? 1 : n_threads;
+    graph.ctx       = ctx0;
+    graph.kv_size   = kv_size;
+    graph.n_tokens  = N;
+    graph.n_kv      = n_kv;
+    graph.n_outputs = n_outputs;
+    graph.n_threads = n_threads;
+
+    graph.k_cpy.resize(n_layer);
+    graph.v_cpy.resize(n_layer);
+
+    // the BLAS matrix multiplications run on one thread with the other threads asleep, the rest of the graph on all threads
+    ggml_cgraph & gf = graph.gf;
+    gf = {};
+    gf.n_threads = n_threads;
+
+    // the inputs are allocated before the graph, so their memory is not reused by the intermediate results
+    // and they can be set before each computation of the graph
 
     struct ggml_tensor * embd = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, N);
+    ggml_allocr_alloc(alloc, embd);
     ggml_set_name(embd, "embd");
-    memcpy(embd->data, tokens, N*ggml_element_size(embd));
+    graph.inp_tokens = embd;
+
+    struct ggml_tensor * inp_pos = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, N);
+    ggml_allocr_alloc(alloc, inp_pos);
+    ggml_set_name(inp_pos, "inp_pos");
+    graph.inp_pos = inp_pos;
+
+    // rows of the final hidden state that go through the lm_head
+    struct ggml_tensor * inp_out_ids = NULL;
+    if (n_outputs > 0 && n_outputs < N) {
+        inp_out_ids = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, n_outputs);
+        ggml_allocr_alloc(alloc, inp_out_ids);
+        ggml_set_name(inp_out_ids, "inp_out_ids");
+    }
+    graph.inp_out_ids = inp_out_ids;
+
+    // KQ_mask shape [n_kv, N]
+    struct ggml_tensor * KQ_mask = ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_kv, N);
+    ggml_allocr_alloc(alloc, KQ_mask);
+    ggml_set_name(KQ_mask, "KQ_mask");
+    graph.inp_KQ_mask = KQ_mask;
+
+    // KQ_scaled = KQ / sqrt(n_embd/n_head)
+    struct ggml_tensor * KQ_scale = ggml_new_f32(ctx0, 1.0f/sqrtf(float(n_embd)/n_head));
+    ggml_set_name(KQ_scale, "1/sqrt(n_embd/n_head)");
 
     struct ggml_tensor * cur;
     struct ggml_tensor * inpL = ggml_get_rows(ctx0, model.tok_embeddings, embd);
@@ -1434,272 +2475,672 @@ static bool llama_eval_internal(
     const int i_gpu_start = n_layer - n_gpu_layers;
     (void) i_gpu_start;
 
+    // the norms are computed with the fused ggml_rms_norm_mul on the CPU, the GPU backends use rms_norm and mul
+    bool fuse_norm = true;
+#ifdef GGML_USE_METAL
+    if (llama_metal_graph(lctx, N)) {
+        fuse_norm = false;
+    }
+#endif
+
+    // the gate and up projections of the feed-forward are fused with the SiLU into ggml_mul_mat_swiglu on the CPU,
+    // except for the batches that BLAS computes faster as separate matrix multiplications
+    const bool fuse_ffn = fuse_norm && !(N >= 32 && ggml_cpu_has_blas());
+
     // offload functions set the tensor output backend to GPU
     // tensors are GPU-accelerated if any input or the output has been offloaded
     //
     // with the low VRAM option VRAM scratch is disabled in llama_load_model_internal
-    // in that case ggml_cuda_assign_buffers has no effect
+    // in that case ggml_cuda_assign_buffers_no_alloc has no effect
     offload_func_t offload_func_nr = llama_nop; // nr = non-repeating
     offload_func_t offload_func_kq = llama_nop;
     offload_func_t offload_func_v  = llama_nop;
 
 #ifdef GGML_USE_CUBLAS
         if (n_gpu_layers > n_layer) {
-            offload_func_nr = ggml_cuda_assign_buffers;
+            offload_func_nr = ggml_cuda_assign_buffers_no_alloc;
         }
         if (n_gpu_layers > n_layer + 1) {
-            offload_func_v  = ggml_cuda_assign_buffers;
+            offload_func_v  = ggml_cuda_assign_buffers_no_alloc;
         }
         if (n_gpu_layers > n_layer + 2) {
-            offload_func_kq = ggml_cuda_assign_buffers;
+            offload_func_kq = ggml_cuda_assign_buffers_no_alloc;
         }
 #endif // GGML_USE_CUBLAS
 
+    // on the CPU, KQV is computed directly in the merged layout of the heads, so wo reads it without a copy
+    const bool merge_kqv = fuse_norm && offload_func_v == llama_nop;
+
     for (int il = 0; il < n_layer; ++il) {
         offload_func_t offload_func = llama_nop;
 
 #ifdef GGML_USE_CUBLAS
         if (il >= i_gpu_start) {
-            offload_func = ggml_cuda_assign_buffers;
+            offload_func = ggml_cuda_assign_buffers_no_alloc;
         }
 #endif // GGML_USE_CUBLAS
 
         struct ggml_tensor * inpSA = inpL;
 
-        lctx.use_buf(ctx0, 0);
+        // norm
+        if (fuse_norm && offload_func == llama_nop) {
+            cur = ggml_rms_norm_mul(ctx0, inpL, model.layers[il].attention_norm);
+            ggml_set_name(cur, "attention_norm_0");
+        } else {
+            cur = ggml_rms_norm(ctx0, inpL);
+            offload_func(cur);
+            ggml_set_name(cur, "rms_norm_0");
+
+            // cur = cur*attention_norm(broadcasted)
+            cur = ggml_mul(ctx0, cur, model.layers[il].attention_norm);
+            offload_func(cur);
+            ggml_set_name(cur, "attention_norm_0");
+        }
+
+        // self-attention
+        {
+            // compute Q, K and V, split into heads for Q and K
+            struct ggml_tensor * tmpq;
+            struct ggml_tensor * tmpk;
+            struct ggml_tensor * tmpv;
+
+            if (model.layers[il].wqkv) {
+                // one matrix multiplication with the concatenated weights, Q, K and V are views of the rows of the result
+                struct ggml_tensor * tmpqkv = ggml_mul_mat(ctx0, model.layers[il].wqkv, cur);
+                ggml_set_name(tmpqkv, "tmpqkv");
+
+                const size_t es = ggml_element_size(tmpqkv);
+
+                tmpq = ggml_view_3d(ctx0, tmpqkv, n_embd/n_head, n_head, N, es*(n_embd/n_head), tmpqkv->nb[1], 0*es*n_embd);
+                tmpk = ggml_view_3d(ctx0, tmpqkv, n_embd/n_head, n_head, N, es*(n_embd/n_head), tmpqkv->nb[1], 1*es*n_embd);
+                tmpv = ggml_view_2d(ctx0, tmpqkv, n_embd, N, tmpqkv->nb[1], 2*es*n_embd);
+            } else {
+                tmpk = ggml_mul_mat(ctx0, model.layers[il].wk, cur);
+                offload_func_kq(tmpk);
+                ggml_set_name(tmpk, "tmpk");
+
+                tmpq = ggml_mul_mat(ctx0, model.layers[il].wq, cur);
+                offload_func_kq(tmpq);
+                ggml_set_name(tmpq, "tmpq");
+
+                tmpv = ggml_mul_mat(ctx0, model.layers[il].wv, cur);
+                offload_func_v(tmpv);
+                ggml_set_name(tmpv, "tmpv");
+
+                tmpk = ggml_reshape_3d(ctx0, tmpk, n_embd/n_head, n_head, N);
+                tmpq = ggml_reshape_3d(ctx0, tmpq, n_embd/n_head, n_head, N);
+                tmpv = ggml_reshape_2d(ctx0, tmpv, n_embd, N);
+            }
+
+            // RoPE Q and K
+            struct ggml_tensor * Kcur = ggml_rope_pos_inplace(ctx0, tmpk, inp_pos, n_rot, 0, 0);
+            offload_func_kq(Kcur);
+            ggml_set_name(Kcur, "Kcur");
+
+            struct ggml_tensor * Qcur = ggml_rope_pos_inplace(ctx0, tmpq, inp_pos, n_rot, 0, 0);
+            offload_func_kq(Qcur);
+            ggml_set_name(Qcur, "Qcur");
+
+            // store key and value to memory
+            {
+                // the [n_embd, N] V matrix, transposed to [N, n_embd] for a transposed cache
+                struct ggml_tensor * Vcur = tmpv;
+                if (kv_self.v_trans) {
+                    Vcur = ggml_transpose(ctx0, Vcur);
+                }
+                offload_func_v(Vcur);
+                ggml_set_name(Vcur, "Vcur");
+
+                struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd, llama_row_size(kv_self.k->type, n_embd)*(il*kv_size + kv_head));
+                offload_func_kq(k);
+                ggml_set_name(k, "k");
+
+                struct ggml_tensor * v = kv_self.v_trans
+                    ? ggml_view_2d(ctx0, kv_self.v, N, n_embd,
+                            (   kv_size)*ggml_element_size(kv_self.v),
+                            (il*kv_size)*ggml_element_size(kv_self.v)*n_embd + kv_head*ggml_element_size(kv_self.v))
+                    : ggml_view_1d(ctx0, kv_self.v, N*n_embd, llama_row_size(kv_self.v->type, n_embd)*(il*kv_size + kv_head));
+                offload_func_v(v);
+                ggml_set_name(v, "v");
+
+                // important: storing RoPE-ed version of K in the KV cache!
+                graph.k_cpy[il] = ggml_cpy(ctx0, Kcur, k);
+                graph.v_cpy[il] = ggml_cpy(ctx0, Vcur, v);
+
+                ggml_build_forward_expand(&gf, graph.k_cpy[il]);
+                ggml_build_forward_expand(&gf, graph.v_cpy[il]);
+            }
+
+            struct ggml_tensor * Q =
+                ggml_permute(ctx0,
+                        Qcur,
+                        0, 2, 1, 3);
+            offload_func_kq(Q);
+            ggml_set_name(Q, "Q");
+
+            struct ggml_tensor * K =
+                ggml_permute(ctx0,
+                        ggml_reshape_3d(ctx0,
+                            ggml_view_1d(ctx0, kv_self.k, n_kv*n_embd, il*kv_size*llama_row_size(kv_self.k->type, n_embd)),
+                            n_embd/n_head, n_head, n_kv),
+                        0, 2, 1, 3);
+            offload_func_kq(K);
+            ggml_set_name(K, "K");
+
+            if (lctx.flash_attn) {
+                // split cached V into n_head heads, [n_embd/n_head, n_kv, n_head]
+                struct ggml_tensor * V = kv_self.v_trans
+                    ? ggml_transpose(ctx0,
+                            ggml_view_3d(ctx0, kv_self.v,
+                                n_kv, n_embd/n_head, n_head,
+                                kv_size*ggml_element_size(kv_self.v),
+                                kv_size*ggml_element_size(kv_self.v)*n_embd/n_head,
+                                il*kv_size*ggml_element_size(kv_self.v)*n_embd))
+                    : ggml_permute(ctx0,
+                            ggml_view_3d(ctx0, kv_self.v,
+                                n_embd/n_head, n_head, n_kv,
+                                llama_row_size(kv_self.v->type, n_embd/n_head),
+                                llama_row_size(kv_self.v->type, n_embd),
+                                il*kv_size*llama_row_size(kv_self.v->type, n_embd)),
+                            0, 2, 1, 3);
+                ggml_set_name(V, "V");
+
+                // softmax(K*Q/sqrt(n_embd/n_head) + KQ_mask)*V in one op, without materializing KQ,
+                // the result has the heads of each token next to each other
+                struct ggml_tensor * KQV = ggml_flash_attn_ext(ctx0, Q, K, V, KQ_mask, 1.0f/sqrtf(float(n_embd)/n_head));
+                ggml_set_name(KQV, "KQV");
+
+                cur = ggml_reshape_2d(ctx0, KQV, n_embd, N);
+                ggml_set_name(cur, "KQV_merged_contiguous");
+            } else {
+                // K * Q
+                struct ggml_tensor * KQ = ggml_mul_mat(ctx0, K, Q);
+                offload_func_kq(KQ);
+                ggml_set_name(KQ, "KQ");
+
+                // KQ_scaled shape [n_kv, N, n_head, 1]
+                struct ggml_tensor * KQ_scaled = ggml_scale_inplace(ctx0, KQ, KQ_scale);
+                offload_func_kq(KQ_scaled);
+                ggml_set_name(KQ_scaled, "KQ_scaled");
+
+                // KQ_masked = KQ_scaled + KQ_mask (broadcasted over the heads)
+                struct ggml_tensor * KQ_masked = ggml_add_inplace(ctx0, KQ_scaled, KQ_mask);
+                offload_func_kq(KQ_masked);
+                ggml_set_name(KQ_masked, "KQ_masked");
+
+                // KQ = soft_max(KQ_masked)
+                struct ggml_tensor * KQ_soft_max = ggml_soft_max_inplace(ctx0, KQ_masked);
+                offload_func_v(KQ_soft_max);
+                ggml_set_name(KQ_soft_max, "KQ_soft_max");
+
+                struct ggml_tensor * KQV;
+
+                if (kv_self.v_trans) {
+                    // split cached V into n_head heads
+                    struct ggml_tensor * V =
+                        ggml_view_3d(ctx0, kv_self.v,
+                                n_kv, n_embd/n_head, n_head,
+                                kv_size*ggml_element_size(kv_self.v),
+                                kv_size*ggml_element_size(kv_self.v)*n_embd/n_head,
+                                il*kv_size*ggml_element_size(kv_self.v)*n_embd);
+                    offload_func_v(V);
+                    ggml_set_name(V, "V");
+
+                    KQV = merge_kqv
+                        ? ggml_mul_mat_permuted(ctx0, V, KQ_soft_max, 0, 2, 1, 3)
+                        : ggml_mul_mat(ctx0, V, KQ_soft_max);
+                } else {
+                    // split cached V into n_head heads, [n_embd/n_head, n_kv, n_head]
+                    struct ggml_tensor * V =
+                        ggml_permute(ctx0,
+                                ggml_view_3d(ctx0, kv_self.v,
+                                    n_embd/n_head, n_head, n_kv,
+                                    llama_row_size(kv_self.v->type, n_embd/n_head),
+                                    llama_row_size(kv_self.v->type, n_embd),
+                                    il*kv_size*llama_row_size(kv_self.v->type, n_embd)),
+                                0, 2, 1, 3);
+                    offload_func_v(V);
+                    ggml_set_name(V, "V");
+
+                    // the sum runs over the cells, i.e. the rows of V - each row is dequantized once and accumulated
+                    KQV = merge_kqv
+                        ? ggml_out_prod_permuted(ctx0, V, ggml_transpose(ctx0, KQ_soft_max), 0, 2, 1, 3)
+                        : ggml_out_prod(ctx0, V, ggml_transpose(ctx0, KQ_soft_max));
+                }
+                offload_func_v(KQV);
+                ggml_set_name(KQV, "KQV");
+
+                // KQV_merged = KQV.permute(0, 2, 1, 3)
+                struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
+                offload_func_v(KQV_merged);
+                ggml_set_name(KQV_merged, "KQV_merged");
+
+                // cur = KQV_merged.contiguous().view(n_embd, N)
+                if (merge_kqv) {
+                    // KQV is stored with the heads of each token next to each other, KQV_merged is already contiguous
+                    cur = ggml_reshape_2d(ctx0, KQV_merged, n_embd, N);
+                } else {
+                    cur = ggml_cpy(ctx0,
+                            KQV_merged,
+                            ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_embd, N));
+                }
+                offload_func_v(cur);
+                ggml_set_name(cur, "KQV_merged_contiguous");
+            }
+
+            // projection (no bias)
+            cur = ggml_mul_mat(ctx0,
+                    model.layers[il].wo,
+                    cur);
+            offload_func(cur);
+            ggml_set_name(cur, "result_wo");
+        }
+
+        struct ggml_tensor * inpFF = ggml_add(ctx0, cur, inpSA);
+        offload_func(inpFF);
+        ggml_set_name(inpFF, "inpFF");
+
+        // feed-forward network
+        {
+            // norm
+            if (fuse_norm && offload_func == llama_nop) {
+                cur = ggml_rms_norm_mul(ctx0, inpFF, model.layers[il].ffn_norm);
+                ggml_set_name(cur, "ffn_norm");
+            } else {
+                cur = ggml_rms_norm(ctx0, inpFF);
+                offload_func(cur);
+                ggml_set_name(cur, "rms_norm_1");
+
+                // cur = cur*ffn_norm(broadcasted)
+                cur = ggml_mul(ctx0, cur, model.layers[il].ffn_norm);
+                offload_func(cur);
+                ggml_set_name(cur, "ffn_norm");
+            }
+
+            if (fuse_ffn && offload_func == llama_nop) {
+                // silu(w1*cur)*(w3*cur) without the intermediate results of w1 and w3
+                cur = ggml_mul_mat_swiglu(ctx0,
+                        model.layers[il].w1,
+                        model.layers[il].w3,
+                        cur);
+                ggml_set_name(cur, "silu_x_result_w3");
+            } else if (model.layers[il].w13) {
+                // one matrix multiplication with the concatenated weights, the results of w1 and w3 are views of its rows
+                const int64_t n_ff = model.layers[il].w1->ne[1];
+
+                struct ggml_tensor * tmp13 = ggml_mul_mat(ctx0,
+                        model.layers[il].w13,
+                        cur);
+                ggml_set_name(tmp13, "result_w13");
+
+                struct ggml_tensor * tmp = ggml_view_2d(ctx0, tmp13, n_ff, N, tmp13->nb[1], n_ff*ggml_element_size(tmp13));
+                ggml_set_name(tmp, "result_w3");
+
+                cur = ggml_view_2d(ctx0, tmp13, n_ff, N, tmp13->nb[1], 0);
+                ggml_set_name(cur, "result_w1");
+
+                // SILU activation
+                cur = ggml_silu(ctx0, cur);
+                ggml_set_name(cur, "silu");
+
+                cur = ggml_mul(ctx0, cur, tmp);
+                ggml_set_name(cur, "silu_x_result_w3");
+            } else {
+                struct ggml_tensor * tmp = ggml_mul_mat(ctx0,
+                        model.layers[il].w3,
+                        cur);
+                offload_func(tmp);
+                ggml_set_name(tmp, "result_w3");
+
+                cur = ggml_mul_mat(ctx0,
+                        model.layers[il].w1,
+                        cur);
+                offload_func(cur);
+                ggml_set_name(cur, "result_w1");
+
+                // SILU activation
+                cur = ggml_silu(ctx0, cur);
+                offload_func(cur);
+                ggml_set_name(cur, "silu");
+
+                cur = ggml_mul(ctx0, cur, tmp);
+                offload_func(cur);
+                ggml_set_name(cur, "silu_x_result_w3");
+            }
+
+            cur = ggml_mul_mat(ctx0,
+                    model.layers[il].w2,
+                    cur);
+            offload_func(cur);
+            ggml_set_name(cur, "result_w2");
+        }
+
+        cur = ggml_add(ctx0, cur, inpFF);
+        offload_func(cur);
+        ggml_set_name(cur, "inpFF_+_result_w2");
+
+        // input for next layer
+        inpL = cur;
+
+    }
+
+    // used at the end to optionally extract the embeddings
+    struct ggml_tensor * embeddings = NULL;
+
+
+    // norm
+    {
+        if (fuse_norm && offload_func_nr == llama_nop) {
+            cur = ggml_rms_norm_mul(ctx0, inpL, model.norm);
+        } else {
+            cur = ggml_rms_norm(ctx0, inpL);
+            offload_func_nr(cur);
+            ggml_set_name(cur, "rms_norm_2");
+
+            // cur = cur*norm(broadcasted)
+            cur = ggml_mul(ctx0, cur, model.norm);
+            // offload_func_nr(cur); // TODO CPU + GPU mirrored backend
+        }
+        ggml_set_name(cur, "result_norm");
+
+        // read after the computation, so its memory must not be reused by the lm_head
+        if (!lctx.embedding.empty()) {
+            ggml_allocr_alloc(alloc, cur);
+        }
+
+        embeddings = cur;
+    }
+
+
+    // lm_head - skip the rows whose logits are not requested
+    if (inp_out_ids) {
+        cur = ggml_get_rows(ctx0, cur, inp_out_ids);
+        ggml_set_name(cur, "result_norm_out");
+    }
+
+    if (n_outputs > 0) {
+        cur = ggml_mul_mat(ctx0, model.output, cur);
+        ggml_set_name(cur, "result_output");
+    }
+
+    // logits -> probs
+    //cur = ggml_soft_max_inplace(ctx0, cur);
+
+    ggml_build_forward_expand(&gf, cur);
+
+    graph.res        = cur;
+    graph.embeddings = embeddings;
+
+    graph.alloc_size = ggml_allocr_alloc_graph(alloc, &gf);
+
+    if (ggml_allocr_is_measure(alloc)) {
+        return;
+    }
+
+#ifdef GGML_USE_CUBLAS
+    // the offloaded tensors get the VRAM at their offset in buf_alloc, the VRAM scratch buffer mirrors it
+    for (int i = 0; i < gf.n_leafs; i++) {
+        struct ggml_tensor * leaf = gf.leafs[i];
+        if (leaf->backend == GGML_BACKEND_GPU && leaf->extra == NULL) {
+            ggml_cuda_assign_scratch_offset(leaf, (char *) leaf->data - (char *) lctx.buf_alloc.addr);
+            ggml_cuda_copy_to_device(leaf);
+        }
+    }
+
+    for (int i = 0; i < gf.n_nodes; i++) {
+        struct ggml_tensor * node = gf.nodes[i];
+        if (node->backend == GGML_BACKEND_GPU && node->extra == NULL) {
+            ggml_cuda_assign_scratch_offset(node, (char *) node->data - (char *) lctx.buf_alloc.addr);
+        }
+    }
+#endif // GGML_USE_CUBLAS
+
+    // the work buffer is kept across graphs and grows when a graph needs more
+    const size_t work_size = ggml_graph_plan(&gf);
+    if (work_size > 0) {
+        if (lctx.buf_work.size < work_size) {
+            lctx.buf_work.resize(work_size);
+        }
+
+        gf.work = ggml_new_tensor_1d(ctx0, GGML_TYPE_I8, work_size);
+        gf.work->data = lctx.buf_work.addr;
+        ggml_set_name(gf.work, "work");
+    }
+}
+
+// size buf_alloc for the largest graph of a batch of n_tokens tokens, in which all the tokens attend to the whole
+// context and output logits, by allocating that graph with a measure allocator
+static void llama_reserve_compute(llama_context & lctx, int n_tokens) {
+    const int n_ctx = lctx.model.hparams.n_ctx;
+
+    auto & graph = lctx.graph;
+
+    if (lctx.alloc) {
+        ggml_allocr_free(lctx.alloc);
+    }
+
+    lctx.alloc = ggml_allocr_new_measure(LLAMA_TENSOR_ALIGNMENT);
+
+    llama_build_graph(lctx, n_tokens, n_ctx, 0, n_tokens, 1);
+
+    const size_t alloc_size = graph.alloc_size + LLAMA_TENSOR_ALIGNMENT;
+
+    // the measured graph has no data
+    ggml_free(graph.ctx);
+    graph.ctx = NULL;
+
+    ggml_allocr_free(lctx.alloc);
+
+    // if the allocation throws, the next eval reserves the compute buffer again
+    lctx.alloc = NULL;
+    lctx.n_tokens_reserved = 0;
+
+    lctx.buf_alloc.resize(alloc_size);
+    lctx.alloc = ggml_allocr_new(lctx.buf_alloc.addr, lctx.buf_alloc.size, LLAMA_TENSOR_ALIGNMENT);
+
+#ifdef GGML_USE_CUBLAS
+    if (lctx.model.n_gpu_layers > 0 && !lctx.model.low_vram) {
+        ggml_cuda_set_scratch_size(alloc_size);
+        fprintf(stderr, "%s: VRAM scratch buffer = %7.2f MB\n", __func__, alloc_size / 1024.0 / 1024.0);
+    }
+#endif // GGML_USE_CUBLAS
+
+    lctx.n_tokens_reserved = n_tokens;
+}
+
+// point the KV cache stores of the graph at the cells [kv_head, kv_head + N)
+static void llama_graph_set_kv_head(llama_context & lctx, int kv_head) {
+    const auto & kv_self = lctx.kv_self;
+    const auto & hparams = lctx.model.hparams;
+
+    const int n_embd  = hparams.n_embd;
+    const int kv_size = kv_self.size;
 
-        // norm
-        {
-            cur = ggml_rms_norm(ctx0, inpL);
-            offload_func(cur);
-            ggml_set_name(cur, "rms_norm_0");
+    auto & graph = lctx.graph;
 
-            // cur = cur*attention_norm(broadcasted)
-            cur = ggml_mul(ctx0, cur, model.layers[il].attention_norm);
-            offload_func(cur);
-            ggml_set_name(cur, "attention_norm_0");
-        }
+    for (int il = 0; il < (int) graph.k_cpy.size(); ++il) {
+        // the result of ggml_cpy is a view of its destination, both have to be moved
+        struct ggml_tensor * k_cpy = graph.k_cpy[il];
+        struct ggml_tensor * v_cpy = graph.v_cpy[il];
 
-        // self-attention
-        {
-            // compute Q and K and RoPE them
-            struct ggml_tensor * tmpk = ggml_mul_mat(ctx0, model.layers[il].wk, cur);
-            offload_func_kq(tmpk);
-            ggml_set_name(tmpk, "tmpk");
+        k_cpy->data = k_cpy->src1->data = (char *) kv_self.k->data + llama_row_size(kv_self.k->type, n_embd)*(il*kv_size + kv_head);
+        v_cpy->data = v_cpy->src1->data = kv_self.v_trans
+            ? (char *) kv_self.v->data + (il*kv_size)*ggml_element_size(kv_self.v)*n_embd + kv_head*ggml_element_size(kv_self.v)
+            : (char *) kv_self.v->data + llama_row_size(kv_self.v->type, n_embd)*(il*kv_size + kv_head);
+    }
+}
 
-            struct ggml_tensor * tmpq = ggml_mul_mat(ctx0, model.layers[il].wq, cur);
-            offload_func_kq(tmpq);
-            ggml_set_name(tmpq, "tmpq");
+// evaluate the transformer
+//
+//   - lctx:         llama context
+//   - batch:        new batch of tokens to process, with the position and sequence id of each token
+//   - n_threads_call: number of threads to use, unless the context sets its own for this size of batch
+//   - cgraph_fname:   filename of the exported computation graph
+//
+static bool llama_eval_internal(
+        llama_context &  lctx,
+          llama_batch    batch,
+            const int    n_threads_call,
+            const char * cgraph_fname) {
 
-            struct ggml_tensor * Kcur = ggml_rope_inplace(ctx0, ggml_reshape_3d(ctx0, tmpk, n_embd/n_head, n_head, N), n_past, n_rot, 0, 0);
-            offload_func_kq(Kcur);
-            ggml_set_name(Kcur, "Kcur");
+    const int N = batch.n_tokens;
 
-            struct ggml_tensor * Qcur = ggml_rope_inplace(ctx0, ggml_reshape_3d(ctx0, tmpq, n_embd/n_head, n_head, N), n_past, n_rot, 0, 0);
-            offload_func_kq(Qcur);
-            ggml_set_name(Qcur, "Qcur");
+    LLAMA_ASSERT(N > 0);
 
-            // store key and value to memory
-            {
-                // compute the transposed [N, n_embd] V matrix
+    const int n_threads_ctx = N == 1 ? lctx.n_threads : lctx.n_threads_batch;
+    const int n_threads     = n_threads_ctx > 0 ? n_threads_ctx : n_threads_call;
 
-                struct ggml_tensor * tmpv = ggml_mul_mat(ctx0, model.layers[il].wv, cur);
-                offload_func_v(tmpv);
-                ggml_set_name(tmpv, "tmpv");
+    lctx.n_threads_eval = n_threads;
 
-                struct ggml_tensor * Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, tmpv, n_embd, N));
-                offload_func_v(Vcur);
-                ggml_set_name(Vcur, "Vcur");
+    // enforce that the first token of each sequence is BOS
+    for (int i = 0; i < N; ++i) {
+        if (batch.pos[i] == 0 && batch.token[i] != llama_token_bos()) {
+            fprintf(stderr, "%s: first token must be BOS\n", __func__);
+            return false;
+        }
+    }
 
-                struct ggml_tensor * k = ggml_view_1d(ctx0, kv_self.k, N*n_embd, (ggml_element_size(kv_self.k)*n_embd)*(il*n_ctx + n_past));
-                offload_func_kq(k);
-                ggml_set_name(k, "k");
+    const int64_t t_start_us = ggml_time_us();
 
-                struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, N, n_embd,
-                        (   n_ctx)*ggml_element_size(kv_self.v),
-                        (il*n_ctx)*ggml_element_size(kv_self.v)*n_embd + n_past*ggml_element_size(kv_self.v));
-                offload_func_v(v);
-                ggml_set_name(v, "v");
+    const auto & model   = lctx.model;
+    const auto & hparams = model.hparams;
 
-                // important: storing RoPE-ed version of K in the KV cache!
-                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, Kcur, k));
-                ggml_build_forward_expand(&gf, ggml_cpy(ctx0, Vcur, v));
-            }
+    auto & kv_self = lctx.kv_self;
 
-            struct ggml_tensor * Q =
-                ggml_permute(ctx0,
-                        Qcur,
-                        0, 2, 1, 3);
-            offload_func_kq(Q);
-            ggml_set_name(Q, "Q");
+    LLAMA_ASSERT(!!kv_self.ctx);
 
-            struct ggml_tensor * K =
-                ggml_permute(ctx0,
-                        ggml_reshape_3d(ctx0,
-                            ggml_view_1d(ctx0, kv_self.k, (n_past + N)*n_embd, il*n_ctx*ggml_element_size(kv_self.k)*n_embd),
-                            n_embd/n_head, n_head, n_past + N),
-                        0, 2, 1, 3);
-            offload_func_kq(K);
-            ggml_set_name(K, "K");
+    llama_kv_cache_apply_shift(lctx, n_threads);
 
-            // K * Q
-            struct ggml_tensor * KQ = ggml_mul_mat(ctx0, K, Q);
-            offload_func_kq(KQ);
-            ggml_set_name(KQ, "KQ");
-
-            // KQ_scaled = KQ / sqrt(n_embd/n_head)
-            struct ggml_tensor * KQ_scale = ggml_new_f32(ctx0, 1.0f/sqrtf(float(n_embd)/n_head));
-            ggml_set_name(KQ_scale, "1/sqrt(n_embd/n_head)");
-
-            // KQ_scaled shape [n_past + N, N, n_head, 1]
-            struct ggml_tensor * KQ_scaled = ggml_scale_inplace(ctx0, KQ, KQ_scale);
-            offload_func_kq(KQ_scaled);
-            ggml_set_name(KQ_scaled, "KQ_scaled");
-
-            // KQ_masked = mask_past(KQ_scaled)
-            struct ggml_tensor * KQ_masked = ggml_diag_mask_inf_inplace(ctx0, KQ_scaled, n_past);
-            offload_func_kq(KQ_masked);
-            ggml_set_name(KQ_masked, "KQ_masked");
-
-            // KQ = soft_max(KQ_masked)
-            struct ggml_tensor * KQ_soft_max = ggml_soft_max_inplace(ctx0, KQ_masked);
-            offload_func_v(KQ_soft_max);
-            ggml_set_name(KQ_soft_max, "KQ_soft_max");
-
-            // split cached V into n_head heads
-            struct ggml_tensor * V =
-                ggml_view_3d(ctx0, kv_self.v,
-                        n_past + N, n_embd/n_head, n_head,
-                        n_ctx*ggml_element_size(kv_self.v),
-                        n_ctx*ggml_element_size(kv_self.v)*n_embd/n_head,
-                        il*n_ctx*ggml_element_size(kv_self.v)*n_embd);
-            offload_func_v(V);
-            ggml_set_name(V, "V");
-
-#if 1
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V, KQ_soft_max);
-            offload_func_v(KQV);
-            ggml_set_name(KQV, "KQV");
-#else
-            // make V contiguous in memory to speed up the matmul, however we waste time on the copy
-            // on M1 this is faster for the perplexity computation, but ~5% slower for the single-token generation
-            // is there a better way?
-            struct ggml_tensor * V_cont = ggml_cpy(ctx0, V, ggml_new_tensor_3d(ctx0, kv_self.v->type, n_past + N, n_embd/n_head, n_head));
-            struct ggml_tensor * KQV = ggml_mul_mat(ctx0, V_cont, KQ_soft_max);
-#endif
+    if (!llama_kv_cache_find_slot(kv_self, batch)) {
+        // grow the storage if there are not enough free cells
+        int n_used = 0;
+        for (const auto & cell : kv_self.cells) {
+            n_used += cell.is_empty() ? 0 : 1;
+        }
 
-            // KQV_merged = KQV.permute(0, 2, 1, 3)
-            struct ggml_tensor * KQV_merged = ggml_permute(ctx0, KQV, 0, 2, 1, 3);
-            offload_func_v(KQV_merged);
-            ggml_set_name(KQV_merged, "KQV_merged");
+        llama_kv_cache_reserve(hparams, kv_self, n_used + N);
 
-            // cur = KQV_merged.contiguous().view(n_embd, N)
-            cur = ggml_cpy(ctx0,
-                    KQV_merged,
-                    ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_embd, N));
-            offload_func_v(cur);
-            ggml_set_name(cur, "KQV_merged_contiguous");
+        if (!llama_kv_cache_find_slot(kv_self, batch)) {
+            // the free cells may be scattered - compact the cache and try again
+            llama_kv_cache_defrag(hparams, kv_self);
 
-            // projection (no bias)
-            cur = ggml_mul_mat(ctx0,
-                    model.layers[il].wo,
-                    cur);
-            offload_func(cur);
-            ggml_set_name(cur, "result_wo");
+            if (!llama_kv_cache_find_slot(kv_self, batch)) {
+                fprintf(stderr, "%s: failed to find a KV cache slot for a batch of %d tokens\n", __func__, N);
+                return false;
+            }
         }
+    }
 
-        lctx.use_buf(ctx0, 1);
+    const int n_embd  = hparams.n_embd;
+    const int kv_size = kv_self.size;
+    const int n_vocab = hparams.n_vocab;
 
-        struct ggml_tensor * inpFF = ggml_add(ctx0, cur, inpSA);
-        offload_func(inpFF);
-        ggml_set_name(inpFF, "inpFF");
+    // cells [kv_head, kv_head + N) receive the new tokens, cells [0, n_kv) are attended to
+    // the empty cells in the padding are masked out
+    const int kv_head = kv_self.head;
+    const int n_kv    = std::min(kv_size, ((kv_self.n + LLAMA_KV_CELLS_PAD - 1)/LLAMA_KV_CELLS_PAD)*LLAMA_KV_CELLS_PAD);
 
-        // feed-forward network
-        {
-            // norm
-            {
-                cur = ggml_rms_norm(ctx0, inpFF);
-                offload_func(cur);
-                ggml_set_name(cur, "rms_norm_1");
+    auto & mem_per_token = lctx.mem_per_token;
 
-                // cur = cur*ffn_norm(broadcasted)
-                cur = ggml_mul(ctx0, cur, model.layers[il].ffn_norm);
-                offload_func(cur);
-                ggml_set_name(cur, "ffn_norm");
+    // rows of the final hidden state that go through the lm_head
+    std::vector<int32_t> out_ids;
+    if (batch.logits) {
+        for (int i = 0; i < N; ++i) {
+            if (batch.logits[i]) {
+                out_ids.push_back(i);
             }
+        }
+    } else if (lctx.logits_all) {
+        for (int i = 0; i < N; ++i) {
+            out_ids.push_back(i);
+        }
+    } else {
+        // return result for just the last token
+        out_ids.push_back(N - 1);
+    }
 
-            struct ggml_tensor * tmp = ggml_mul_mat(ctx0,
-                    model.layers[il].w3,
-                    cur);
-            offload_func(tmp);
-            ggml_set_name(tmp, "result_w3");
-
-            cur = ggml_mul_mat(ctx0,
-                    model.layers[il].w1,
-                    cur);
-            offload_func(cur);
-            ggml_set_name(cur, "result_w1");
+    const int n_outputs = out_ids.size();
 
-            // SILU activation
-            cur = ggml_silu(ctx0, cur);
-            offload_func(cur);
-            ggml_set_name(cur, "silu");
+    auto & graph = lctx.graph;
 
-            cur = ggml_mul(ctx0, cur, tmp);
-            offload_func(cur);
-            ggml_set_name(cur, "silu_x_result_w3");
+    // the offloaded tensors of a GPU graph hold backend data that is not rebound, so it is always rebuilt
+    const bool can_reuse = model.n_gpu_layers == 0 && graph.ctx != NULL &&
+        graph.kv_size   == kv_size &&
+        graph.n_tokens  == N &&
+        graph.n_kv      == n_kv &&
+        graph.n_outputs == n_outputs &&
+        graph.n_threads == n_threads;
 
-            cur = ggml_mul_mat(ctx0,
-                    model.layers[il].w2,
-                    cur);
-            offload_func(cur);
-            ggml_set_name(cur, "result_w2");
+    if (can_reuse) {
+        llama_graph_set_kv_head(lctx, kv_head);
+        lctx.n_graph_hit++;
+    } else {
+        // a batch larger than n_batch needs a larger compute buffer
+        if (N > lctx.n_tokens_reserved) {
+            try {
+                llama_reserve_compute(lctx, N);
+            } catch (const std::exception & err) {
+                fprintf(stderr, "%s: failed to allocate the compute buffer for a batch of %d tokens: %s\n", __func__, N, err.what());
+                llama_kv_cache_free_slot(kv_self, batch);
+                return false;
+            }
         }
 
-        cur = ggml_add(ctx0, cur, inpFF);
-        offload_func(cur);
-        ggml_set_name(cur, "inpFF_+_result_w2");
+        llama_build_graph(lctx, N, n_kv, kv_head, n_outputs, n_threads);
+        lctx.n_graph_miss++;
+    }
 
-        // input for next layer
-        inpL = cur;
+    ggml_cgraph & gf = graph.gf;
 
-    }
+    struct ggml_tensor * cur        = graph.res;
+    struct ggml_tensor * embeddings = graph.embeddings;
 
-    lctx.use_buf(ctx0, 0);
+    // set the inputs
+    {
+        memcpy(graph.inp_tokens->data, batch.token, N*ggml_element_size(graph.inp_tokens));
+        memcpy(graph.inp_pos->data,    batch.pos,   N*ggml_element_size(graph.inp_pos));
 
-    // used at the end to optionally extract the embeddings
-    struct ggml_tensor * embeddings = NULL;
+        if (graph.inp_out_ids) {
+            memcpy(graph.inp_out_ids->data, out_ids.data(), n_outputs*ggml_element_size(graph.inp_out_ids));
+        }
 
+        // a token attends only to the cells of its own sequence at positions <= its own
+        // the cells of each sequence of the batch are looked up once: seq_pos holds the position of the cells
+        // of the sequence and INT_MAX for the others, so a row of the mask only compares positions
+        auto & seq_ids = lctx.mask_seq_ids;
+        auto & seq_pos = lctx.mask_seq_pos;
 
-    // norm
-    {
-        cur = ggml_rms_norm(ctx0, inpL);
-        offload_func_nr(cur);
-        ggml_set_name(cur, "rms_norm_2");
+        seq_ids.clear();
 
-        // cur = cur*norm(broadcasted)
-        cur = ggml_mul(ctx0, cur, model.norm);
-        // offload_func_nr(cur); // TODO CPU + GPU mirrored backend
-        ggml_set_name(cur, "result_norm");
+        float * data = (float *) graph.inp_KQ_mask->data;
 
-        embeddings = cur;
-    }
+        for (int j = 0; j < N; ++j) {
+            const llama_pos    pos    = batch.pos[j];
+            const llama_seq_id seq_id = batch.seq_id[j];
 
+            size_t s = std::find(seq_ids.begin(), seq_ids.end(), seq_id) - seq_ids.begin();
 
-    // lm_head
-    cur = ggml_mul_mat(ctx0, model.output, cur);
-    ggml_set_name(cur, "result_output");
+            if (s == seq_ids.size()) {
+                seq_ids.push_back(seq_id);
+                seq_pos.resize(seq_ids.size()*n_kv);
 
-    lctx.use_buf(ctx0, -1);
+                for (int i = 0; i < n_kv; ++i) {
+                    const llama_kv_cell & cell = kv_self.cells[i];
+                    seq_pos[s*n_kv + i] = cell.has_seq_id(seq_id) ? cell.pos : INT_MAX;
+                }
+            }
 
-    // logits -> probs
-    //cur = ggml_soft_max_inplace(ctx0, cur);
+            const llama_pos * row = seq_pos.data() + s*n_kv;
 
-    // run the computation
-    ggml_build_forward_expand(&gf, cur);
+            for (int i = 0; i < n_kv; ++i) {
+                data[j*n_kv + i] = row[i] <= pos ? 0.0f : -INFINITY;
+            }
+        }
+    }
 
+    // run the computation
 #ifdef GGML_USE_METAL
-    if (lctx.ctx_metal && N == 1) {
+    if (llama_metal_graph(lctx, N)) {
         ggml_metal_graph_compute(lctx.ctx_metal, &gf);
         ggml_metal_get_tensor   (lctx.ctx_metal, cur);
     } else {
@@ -1719,10 +3160,10 @@ static bool llama_eval_internal(
             ggml_metal_get_tensor(lctx.ctx_metal, kv_self.v);
         }
 
-        ggml_graph_compute(ctx0, &gf);
+        llama_graph_compute(lctx, graph.ctx, &gf);
     }
 #else
-    ggml_graph_compute(ctx0, &gf);
+    llama_graph_compute(lctx, graph.ctx, &gf);
 #endif
 
     if (cgraph_fname) {
@@ -1736,27 +3177,26 @@ static bool llama_eval_internal(
 #endif
 
     // plot the computation graph in dot format (for debugging purposes)
-    //if (n_past%100 == 0) {
+    //if (kv_head%100 == 0) {
     //    ggml_graph_dump_dot(&gf, NULL, "llama.dot");
     //}
 
     //embd_w.resize(n_vocab*N);
     //memcpy(embd_w.data(), ggml_get_data(cur), sizeof(float)*n_vocab*N);
 
-    // update kv token count
-    lctx.kv_self.n = n_past + N;
-
     // extract logits
     {
-        auto & logits_out = lctx.logits;
+        auto & logits_out  = lctx.logits;
+        auto & logits_rows = lctx.logits_rows;
 
-        if (lctx.logits_all) {
-            logits_out.resize(n_vocab * N);
-            memcpy(logits_out.data(), (float *) ggml_get_data(cur), sizeof(float)*n_vocab*N);
-        } else {
-            // return result for just the last token
-            logits_out.resize(n_vocab);
-            memcpy(logits_out.data(), (float *) ggml_get_data(cur) + (n_vocab*(N-1)), sizeof(float)*n_vocab);
+        logits_out.resize(n_vocab * n_outputs);
+        if (n_outputs > 0) {
+            memcpy(logits_out.data(), (float *) ggml_get_data(cur), sizeof(float)*n_vocab*n_outputs);
+        }
+
+        logits_rows.assign(N, -1);
+        for (int i = 0; i < n_outputs; ++i) {
+            logits_rows[out_ids[i]] = i;
         }
     }
 
@@ -1769,18 +3209,15 @@ static bool llama_eval_internal(
     }
 
     if (mem_per_token == 0) {
-        mem_per_token = ggml_used_mem(ctx0)/N;
+        mem_per_token = ggml_used_mem(graph.ctx)/N;
     }
 
 #if 0
-    printf("\n%s: used_mem = %.3f MB, scratch -- %.3f MB %.3f MB\n", __func__,
-            ggml_used_mem(ctx0)/1024.0/1024.0,
-            lctx.get_buf_max_mem(0)/1024.0/1024.0,
-            lctx.get_buf_max_mem(1)/1024.0/1024.0);
+    printf("\n%s: used_mem = %.3f MB, alloc = %.3f MB\n", __func__,
+            ggml_used_mem(graph.ctx)/1024.0/1024.0,
+            graph.alloc_size/1024.0/1024.0);
 #endif
 
-    ggml_free(ctx0);
-
     // measure the performance only for the single-token evals
     if (N == 1) {
         lctx.t_eval_us += ggml_time_us() - t_start_us;
@@ -2451,7 +3888,7 @@ static void llama_model_quantize_internal(const std::string & fname_inp, const s
         nthread = std::thread::hardware_concurrency();
     }
 
-    std::unique_ptr<llama_model_loader> model_loader(new llama_model_loader(fname_inp, /*use_mmap*/ false,
+    std::unique_ptr<llama_model_loader> model_loader(new llama_model_loader(fname_inp, /*use_mmap*/ false, /*repack*/ false,
                                                                             /*vocab_only*/ false));
     llama_file_saver file_saver(fname_out.c_str(), model_loader->file_loaders.at(0).get(), params->ftype);
 
@@ -2658,18 +4095,31 @@ static void llama_model_quantize_internal(const std::string & fname_inp, const s
 // interface implementation
 //
 
+// the cache types selected by the deprecated f16_kv = false, an F32 cache
+static void llama_context_params_apply_f16_kv(struct llama_context_params & params) {
+    if (params.f16_kv) {
+        return;
+    }
+    if (params.type_k == GGML_TYPE_F16) {
+        params.type_k = GGML_TYPE_F32;
+    }
+    if (params.type_v == GGML_TYPE_F16) {
+        params.type_v = GGML_TYPE_F32;
+    }
+}
+
 struct llama_model * llama_load_model_from_file(
                              const char * path_model,
             struct llama_context_params   params) {
     ggml_time_init();
 
-    llama_model * model = new llama_model;
+    llama_context_params_apply_f16_kv(params);
 
-    ggml_type memory_type = params.f16_kv ? GGML_TYPE_F16 : GGML_TYPE_F32;
+    llama_model * model = new llama_model;
 
     if (!llama_model_load(path_model, *model, model->vocab, params.n_ctx, params.n_batch, params.n_gpu_layers,
-                params.main_gpu, params.tensor_split, params.low_vram, memory_type, params.use_mmap, params.use_mlock,
-                params.vocab_only, params.progress_callback, params.progress_callback_user_data)) {
+                params.main_gpu, params.tensor_split, params.low_vram, params.type_k, params.type_v, params.use_mmap, params.use_mlock,
+                params.repack, params.concat_weights, params.vocab_only, params.progress_callback, params.progress_callback_user_data)) {
         delete model;
         fprintf(stderr, "%s: failed to load model\n", __func__);
         return nullptr;
@@ -2690,6 +4140,8 @@ struct llama_context * llama_new_context_with_model(
         return nullptr;
     }
 
+    llama_context_params_apply_f16_kv(params);
+
     llama_context * ctx = new llama_context(*model, model->vocab);
 
     if (params.seed < 0) {
@@ -2716,11 +4168,32 @@ struct llama_context * llama_new_context_with_model(
     ctx->rng = std::mt19937(params.seed);
     ctx->logits_all = params.logits_all;
 
-    ggml_type memory_type = params.f16_kv ? GGML_TYPE_F16 : GGML_TYPE_F32;
+    ctx->n_threads       = params.n_threads;
+    ctx->n_threads_batch = params.n_threads_batch;
+
+    // the fused attention has no GPU implementation
+    ctx->flash_attn = params.flash_attn;
+#if defined(GGML_USE_CUBLAS)
+    if (params.n_gpu_layers > (int) ctx->model.hparams.n_layer) {
+        ctx->flash_attn = false;
+    }
+#elif defined(GGML_USE_METAL)
+    if (params.n_gpu_layers > 0) {
+        ctx->flash_attn = false;
+    }
+#endif
 
     // reserve memory for context buffers
     if (!params.vocab_only) {
-        if (!kv_cache_init(ctx->model.hparams, ctx->kv_self, memory_type, ctx->model.hparams.n_ctx, params.n_gpu_layers)) {
+        if (!llama_kv_cache_type_supported(ctx->model.hparams, params.type_k, params.n_gpu_layers) ||
+            !llama_kv_cache_type_supported(ctx->model.hparams, params.type_v, params.n_gpu_layers)) {
+            fprintf(stderr, "%s: unsupported KV cache type K = %s, V = %s\n", __func__,
+                    ggml_type_name(params.type_k), ggml_type_name(params.type_v));
+            llama_free(ctx);
+            return nullptr;
+        }
+
+        if (!kv_cache_init(ctx->model.hparams, ctx->kv_self, params.type_k, params.type_v, ctx->model.hparams.n_ctx, params.n_gpu_layers, params.v_rows)) {
             fprintf(stderr, "%s: kv_cache_init() failed for self-attention cache\n", __func__);
             llama_free(ctx);
             return nullptr;
@@ -2729,6 +4202,12 @@ struct llama_context * llama_new_context_with_model(
         {
             const size_t memory_size = ggml_nbytes(ctx->kv_self.k) + ggml_nbytes(ctx->kv_self.v);
             fprintf(stderr, "%s: kv self size  = %7.2f MB\n", __func__, memory_size / 1024.0 / 1024.0);
+
+            if (ctx->kv_self.growable) {
+                const size_t memory_size_max = llama_kv_cache_data_size(ctx->model.hparams, ctx->kv_self, ctx->model.hparams.n_ctx);
+                fprintf(stderr, "%s: kv self size doubles as the cache fills up, up to %7.2f MB\n", __func__,
+                        memory_size_max / 1024.0 / 1024.0);
+            }
         }
 
         const auto & hparams = ctx->model.hparams;
@@ -2744,10 +4223,32 @@ struct llama_context * llama_new_context_with_model(
             ctx->embedding.resize(hparams.n_embd);
         }
 
-        ctx->buf_compute.resize(MEM_REQ_EVAL().at(ctx->model.type));
+        // the objects of the tensors of a graph - at most GGML_MAX_NODES nodes and as many leafs - and the
+        // small parameters of the ops, the data of the tensors is in buf_alloc
+        ctx->buf_compute.resize(2*GGML_MAX_NODES*ggml_tensor_overhead() + MB);
+
+        llama_reserve_compute(*ctx, std::min(params.n_batch, (int) hparams.n_ctx));
+
+        fprintf(stderr, "%s: compute buffer total size = %7.2f MB\n", __func__,
+                (ctx->buf_compute.size + ctx->buf_alloc.size) / 1024.0 / 1024.0);
+
+        if (params.calibrate) {
+            // the pool is kept for the evals
+            int n_threads = std::max(params.n_threads, params.n_threads_batch);
+            if (n_threads <= 0) {
+                n_threads = std::thread::hardware_concurrency();
+            }
+            if (n_threads > 1) {
+                ctx->threadpool = ggml_threadpool_new(n_threads);
+            }
 
-        ctx->buf_scratch[0].resize(MEM_REQ_SCRATCH0().at(ctx->model.type));
-        ctx->buf_scratch[1].resize(MEM_REQ_SCRATCH1().at(ctx->model.type));
+            // most of the flops of an eval are in the products with the weights
+            const ggml_type type = ctx->model.layers[0].wo->type;
+
+            const ggml_cost_model & cost = ctx->cost_model = ggml_calibrate_cost_model(ctx->threadpool, type);
+            fprintf(stderr, "%s: cost model = %.0f flops/us (%s), %.0f bytes/us, %.2f us per thread of a node (%d threads)\n", __func__,
+                    cost.flops_per_us, ggml_type_name(type), cost.bytes_per_us, cost.task_us, std::max(n_threads, 1));
+        }
     }
 
 #ifdef GGML_USE_METAL
@@ -2782,8 +4283,8 @@ struct llama_context * llama_new_context_with_model(
         LLAMA_METAL_CHECK_BUF(ggml_metal_add_buffer(ctx->ctx_metal, "eval", ctx->buf_compute.addr, ctx->buf_compute.size, 0));
         LLAMA_METAL_CHECK_BUF(ggml_metal_add_buffer(ctx->ctx_metal, "kv",   ctx->kv_self.buf.addr, ctx->kv_self.buf.size, 0));
 
-        LLAMA_METAL_CHECK_BUF(ggml_metal_add_buffer(ctx->ctx_metal, "scr0", ctx->buf_scratch[0].addr, ctx->buf_scratch[0].size, 0));
-        LLAMA_METAL_CHECK_BUF(ggml_metal_add_buffer(ctx->ctx_metal, "scr1", ctx->buf_scratch[1].addr, ctx->buf_scratch[1].size, 0));
+        LLAMA_METAL_CHECK_BUF(ggml_metal_add_buffer(ctx->ctx_metal, "alloc", ctx->buf_alloc.addr, ctx->buf_alloc.size, 0));
+        ctx->metal_buf_alloc = ctx->buf_alloc.addr;
 #undef LLAMA_METAL_CHECK_BUF
     }
 #endif
@@ -2885,7 +4386,7 @@ int llama_apply_lora_from_file_internal(const struct llama_model & model, const
     llama_buffer base_buf;
     if (path_base_model) {
         fprintf(stderr, "%s: loading base model from '%s'\n", __func__, path_base_model);
-        model_loader.reset(new llama_model_loader(path_base_model, /*use_mmap*/ true, /*vocab_only*/ false));
+        model_loader.reset(new llama_model_loader(path_base_model, /*use_mmap*/ true, /*repack*/ false, /*vocab_only*/ false));
 
         size_t ctx_size;
         size_t mmapped_size;
@@ -2987,6 +4488,10 @@ int llama_apply_lora_from_file_internal(const struct llama_model & model, const
             lora_tensors.find(base_name + ".loraB") != lora_tensors.end()) {
 
             ggml_tensor * dest_t = model_tensors[base_name];
+            if (dest_t->type == GGML_TYPE_Q4_0_X4 || dest_t->type == GGML_TYPE_Q4_K_X4) {
+                fprintf(stderr, "%s: error: cannot apply a lora adapter to the repacked tensor '%s', load the model without repacking\n", __func__, base_name.c_str());
+                return 1;
+            }
             ggml_tensor * base_t;
             if (model_loader) {
                 // load from base model
@@ -3086,7 +4591,26 @@ int llama_model_apply_lora_from_file(const struct llama_model * model, const cha
 }
 
 int llama_get_kv_cache_token_count(const struct llama_context * ctx) {
-    return ctx->kv_self.n;
+    int n_tokens = 0;
+    for (const auto & cell : ctx->kv_self.cells) {
+        if (!cell.is_empty()) {
+            n_tokens++;
+        }
+    }
+    return n_tokens;
+}
+
+void llama_kv_cache_seq_rm(struct llama_context * ctx, llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
+    llama_kv_cache_seq_rm(ctx->kv_self, seq_id, p0, p1);
+    llama_kv_cache_shrink(ctx->model.hparams, ctx->kv_self);
+}
+
+void llama_kv_cache_seq_cp(struct llama_context * ctx, llama_seq_id seq_id_src, llama_seq_id seq_id_dst, llama_pos p0, llama_pos p1) {
+    llama_kv_cache_seq_cp(ctx->kv_self, seq_id_src, seq_id_dst, p0, p1);
+}
+
+void llama_kv_cache_seq_shift(struct llama_context * ctx, llama_seq_id seq_id, llama_pos p0, llama_pos p1, llama_pos delta) {
+    llama_kv_cache_seq_shift(ctx->model.hparams, ctx->kv_self, seq_id, p0, p1, delta);
 }
 
 #define LLAMA_MAX_RNG_STATE (64*1024)
@@ -3111,7 +4635,16 @@ size_t llama_get_state_size(const struct llama_context * ctx) {
     const size_t s_embedding       = ctx->embedding.size() * sizeof(float);
     const size_t s_kv_size         = sizeof(size_t);
     const size_t s_kv_ntok         = sizeof(int);
-    const size_t s_kv              = ctx->kv_self.buf.size;
+    const size_t s_kv_type         = 3*sizeof(int32_t);
+    // the cache grows with the number of tokens, the state is sized for a full context
+    const size_t s_kv              = llama_kv_cache_data_size(ctx->model.hparams, ctx->kv_self, ctx->model.hparams.n_ctx);
+    // pos, delta and number of sequences of each cell, then its sequence ids - at least one per cell
+    size_t n_kv_seq_id = 0;
+    for (const auto & cell : ctx->kv_self.cells) {
+        n_kv_seq_id += cell.seq_id.size();
+    }
+    const size_t s_kv_cells        = 3*sizeof(int32_t)*ctx->model.hparams.n_ctx
+                                   + sizeof(int32_t)*std::max(n_kv_seq_id, (size_t) ctx->model.hparams.n_ctx);
 
     const size_t s_total = (
         + s_rng_size
@@ -3123,7 +4656,9 @@ size_t llama_get_state_size(const struct llama_context * ctx) {
         + s_embedding
         + s_kv_size
         + s_kv_ntok
+        + s_kv_type
         + s_kv
+        + s_kv_cells
     );
 
     return s_total;
@@ -3179,44 +4714,37 @@ size_t llama_copy_state_data(struct llama_context * ctx, uint8_t * dst) {
     {
         const auto & kv_self = ctx->kv_self;
         const auto & hparams = ctx->model.hparams;
-        const int    n_layer = hparams.n_layer;
-        const int    n_embd  = hparams.n_embd;
-        const int    n_ctx   = hparams.n_ctx;
 
+        // only the cells up to the last used one are saved
         const size_t kv_size = kv_self.buf.size;
-        const int    kv_ntok = llama_get_kv_cache_token_count(ctx);
+        const int    kv_ntok = kv_self.n;
 
         memcpy(out, &kv_size, sizeof(kv_size)); out += sizeof(kv_size);
         memcpy(out, &kv_ntok, sizeof(kv_ntok)); out += sizeof(kv_ntok);
 
         if (kv_size) {
-            const size_t elt_size = ggml_element_size(kv_self.k);
-
-            ggml_context * cpy_ctx = ggml_init({ 4096, NULL, /* no_alloc */ true });
-            ggml_cgraph gf{};
-            gf.n_threads = 1;
+            // the layout of V is part of the state, the cells are copied as they are stored
+            const int32_t kv_type[3] = { kv_self.k->type, kv_self.v->type, kv_self.v_trans };
 
-            ggml_tensor * kout3d = ggml_new_tensor_3d(cpy_ctx, kv_self.k->type, n_embd, kv_ntok, n_layer);
-            kout3d->data = out;
-            out += ggml_nbytes(kout3d);
+            memcpy(out, kv_type, sizeof(kv_type)); out += sizeof(kv_type);
 
-            ggml_tensor * vout3d = ggml_new_tensor_3d(cpy_ctx, kv_self.v->type, kv_ntok, n_embd, n_layer);
-            vout3d->data = out;
-            out += ggml_nbytes(vout3d);
+            // the rows of the cells are copied as they are, so any (quantized) type is supported
+            llama_kv_cache_get_data(hparams, kv_self, kv_ntok, out);
+            out += llama_kv_cache_data_size(hparams, kv_self, kv_ntok);
 
-            ggml_tensor * k3d = ggml_view_3d(cpy_ctx, kv_self.k,
-                n_embd, kv_ntok, n_layer,
-                elt_size*n_embd, elt_size*n_embd*n_ctx, 0);
+            // the cell metadata, so that removed, shifted and shared cells are restored as they are
+            for (int i = 0; i < kv_ntok; ++i) {
+                const auto & cell = kv_self.cells[i];
 
-            ggml_tensor * v3d = ggml_view_3d(cpy_ctx, kv_self.v,
-                kv_ntok, n_embd, n_layer,
-                elt_size*n_ctx, elt_size*n_ctx*n_embd, 0);
+                const int32_t cell_info[3] = { cell.pos, cell.delta, (int32_t) cell.seq_id.size() };
 
-            ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, k3d, kout3d));
-            ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, v3d, vout3d));
-            ggml_graph_compute(cpy_ctx, &gf);
+                memcpy(out, cell_info, sizeof(cell_info)); out += sizeof(cell_info);
 
-            ggml_free(cpy_ctx);
+                for (const llama_seq_id seq_id : cell.seq_id) {
+                    const int32_t id = seq_id;
+                    memcpy(out, &id, sizeof(id)); out += sizeof(id);
+                }
+            }
         }
     }
 
@@ -3281,11 +4809,8 @@ size_t llama_set_state_data(struct llama_context * ctx, uint8_t * src) {
 
     // set kv cache
     {
-        const auto & kv_self = ctx->kv_self;
+        auto & kv_self = ctx->kv_self;
         const auto & hparams = ctx->model.hparams;
-        const int    n_layer = hparams.n_layer;
-        const int    n_embd  = hparams.n_embd;
-        const int    n_ctx   = hparams.n_ctx;
 
         size_t kv_size;
         int kv_ntok;
@@ -3293,39 +4818,69 @@ size_t llama_set_state_data(struct llama_context * ctx, uint8_t * src) {
         memcpy(&kv_size, inp, sizeof(kv_size)); inp += sizeof(kv_size);
         memcpy(&kv_ntok, inp, sizeof(kv_ntok)); inp += sizeof(kv_ntok);
 
+        for (auto & cell : kv_self.cells) {
+            cell.seq_id.clear();
+            cell.pos   = -1;
+            cell.delta =  0;
+        }
+
+        kv_self.has_shift = false;
+
+        llama_kv_cache_update_n(kv_self);
+
         if (kv_size) {
-            LLAMA_ASSERT(kv_self.buf.size == kv_size);
+            int32_t kv_type[3];
+
+            memcpy(kv_type, inp, sizeof(kv_type)); inp += sizeof(kv_type);
+
+            if (kv_type[0] != kv_self.type_k || kv_type[1] != kv_self.type_v) {
+                fprintf(stderr, "%s : the KV cache types of the state (%s, %s) don't match the context (%s, %s)\n", __func__,
+                        ggml_type_name((ggml_type) kv_type[0]), ggml_type_name((ggml_type) kv_type[1]),
+                        ggml_type_name(kv_self.type_k), ggml_type_name(kv_self.type_v));
+                return 0;
+            }
+
+            if (kv_self.v_trans != (kv_type[2] != 0)) {
+                fprintf(stderr, "%s : the V cache of the state is %s, the one of the context is %s\n", __func__,
+                        kv_type[2] ? "transposed" : "in rows", kv_self.v_trans ? "transposed" : "in rows");
+                return 0;
+            }
 
-            const size_t elt_size = ggml_element_size(kv_self.k);
+            if (!llama_kv_cache_reserve(hparams, kv_self, kv_ntok)) {
+                fprintf(stderr, "%s : failed to reserve %d cells of the KV cache\n", __func__, kv_ntok);
+                return 0;
+            }
+
+            llama_kv_cache_set_data(hparams, kv_self, kv_ntok, inp);
+            inp += llama_kv_cache_data_size(hparams, kv_self, kv_ntok);
 
-            ggml_context * cpy_ctx = ggml_init({ 4096, NULL, /* no_alloc */ true });
-            ggml_cgraph gf{};
-            gf.n_threads = 1;
+            for (int i = 0; i < kv_ntok; ++i) {
+                auto & cell = kv_self.cells[i];
 
-            ggml_tensor * kin3d = ggml_new_tensor_3d(cpy_ctx, kv_self.k->type, n_embd, kv_ntok, n_layer);
-            kin3d->data = (void *) inp;
-            inp += ggml_nbytes(kin3d);
+                int32_t cell_info[3];
 
-            ggml_tensor * vin3d = ggml_new_tensor_3d(cpy_ctx, kv_self.v->type, kv_ntok, n_embd, n_layer);
-            vin3d->data = (void *) inp;
-            inp += ggml_nbytes(vin3d);
+                memcpy(cell_info, inp, sizeof(cell_info)); inp += sizeof(cell_info);
 
-            ggml_tensor * k3d = ggml_view_3d(cpy_ctx, kv_self.k,
-                n_embd, kv_ntok, n_layer,
-                elt_size*n_embd, elt_size*n_embd*n_ctx, 0);
+                cell.pos   = cell_info[0];
+                cell.delta = cell_info[1];
 
-            ggml_tensor * v3d = ggml_view_3d(cpy_ctx, kv_self.v,
-                kv_ntok, n_embd, n_layer,
-                elt_size*n_ctx, elt_size*n_ctx*n_embd, 0);
+                for (int32_t j = 0; j < cell_info[2]; ++j) {
+                    int32_t id;
+                    memcpy(&id, inp, sizeof(id)); inp += sizeof(id);
+                    cell.seq_id.insert(id);
+                }
 
-            ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, kin3d, k3d));
-            ggml_build_forward_expand(&gf, ggml_cpy(cpy_ctx, vin3d, v3d));
-            ggml_graph_compute(cpy_ctx, &gf);
+                // the K of a cell with a pending delta is rotated by the next eval
+                kv_self.has_shift |= cell.delta != 0;
+            }
 
-            ggml_free(cpy_ctx);
+            llama_kv_cache_update_n(kv_self);
         }
 
-        ctx->kv_self.n = kv_ntok;
+        // the storage of a larger cache is not needed for a smaller state
+        if (!llama_kv_cache_shrink(hparams, kv_self)) {
+            return 0;
+        }
     }
 
     const size_t nread    = inp - src;
@@ -3356,6 +4911,23 @@ bool llama_load_session_file(struct llama_context * ctx, const char * path_sessi
             fprintf(stderr, "%s : model hparams didn't match from session file!\n", __func__);
             return false;
         }
+
+        // the cells are restored as they are stored, so the cache of the context must have the same types and V layout
+        int32_t session_kv_type[3];
+        file.read_raw(session_kv_type, sizeof(session_kv_type));
+
+        if (session_kv_type[0] != ctx->kv_self.type_k || session_kv_type[1] != ctx->kv_self.type_v) {
+            fprintf(stderr, "%s : KV cache types didn't match from session file! got (%s, %s), expected (%s, %s)\n", __func__,
+                    ggml_type_name((ggml_type) session_kv_type[0]), ggml_type_name((ggml_type) session_kv_type[1]),
+                    ggml_type_name(ctx->kv_self.type_k), ggml_type_name(ctx->kv_self.type_v));
+            return false;
+        }
+
+        if ((session_kv_type[2] != 0) != ctx->kv_self.v_trans) {
+            fprintf(stderr, "%s : V cache layout didn't match from session file! got %s, expected %s\n", __func__,
+                    session_kv_type[2] ? "transposed" : "rows", ctx->kv_self.v_trans ? "transposed" : "rows");
+            return false;
+        }
     }
 
     // load the prompt
@@ -3376,15 +4948,21 @@ bool llama_load_session_file(struct llama_context * ctx, const char * path_sessi
         const size_t n_state_size_cur = file.size - file.tell();
         const size_t n_state_size_max = llama_get_state_size(ctx);
 
-        if (n_state_size_cur > n_state_size_max) {
-            fprintf(stderr, "%s : the state size in session file is too big! max %zu, got %zu\n", __func__, n_state_size_max, n_state_size_cur);
+        // the bound of llama_get_state_size grows with the sequence ids stored in the cells, so a cache
+        // whose cells are shared by several sequences can save a state larger than the bound of a fresh context
+        std::vector<uint8_t> state_data(std::max(n_state_size_cur, n_state_size_max));
+        file.read_raw(state_data.data(), n_state_size_cur);
+
+        const size_t n_state_size_read = llama_set_state_data(ctx, state_data.data());
+
+        if (n_state_size_read == 0) {
             return false;
         }
 
-        std::vector<uint8_t> state_data(n_state_size_max);
-        file.read_raw(state_data.data(), n_state_size_cur);
-
-        llama_set_state_data(ctx, state_data.data());
+        if (n_state_size_read != n_state_size_cur) {
+            fprintf(stderr, "%s : the state size in session file didn't match! expected %zu, got %zu\n", __func__, n_state_size_read, n_state_size_cur);
+            return false;
+        }
     }
 
     return true;
@@ -3398,6 +4976,9 @@ bool llama_save_session_file(struct llama_context * ctx, const char * path_sessi
 
     file.write_raw(&ctx->model.hparams, sizeof(llama_hparams));
 
+    const int32_t kv_type[3] = { ctx->kv_self.type_k, ctx->kv_self.type_v, ctx->kv_self.v_trans };
+    file.write_raw(kv_type, sizeof(kv_type));
+
     // save the prompt
     file.write_u32((uint32_t) n_token_count);
     file.write_raw(tokens, sizeof(llama_token) * n_token_count);
@@ -3421,7 +5002,19 @@ int llama_eval(
                          int   n_tokens,
                          int   n_past,
                          int   n_threads) {
-    if (!llama_eval_internal(*ctx, tokens, n_tokens, n_past, n_threads, nullptr)) {
+    // sequence 0 continues at n_past - drop whatever was cached after it
+    llama_kv_cache_seq_rm(ctx->kv_self, 0, n_past, -1);
+
+    std::vector<llama_pos>    pos(n_tokens);
+    std::vector<llama_seq_id> seq_id(n_tokens, 0);
+
+    for (int i = 0; i < n_tokens; ++i) {
+        pos[i] = n_past + i;
+    }
+
+    const llama_batch batch = { n_tokens, const_cast<llama_token *>(tokens), pos.data(), seq_id.data(), nullptr };
+
+    if (!llama_eval_internal(*ctx, batch, n_threads, nullptr)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
@@ -3440,16 +5033,83 @@ int llama_eval_export(struct llama_context * ctx, const char * fname) {
     const int n_batch = 1;
     const int n_ctx   = 512 - n_batch;
 
-    const std::vector<llama_token> tmp(n_batch, llama_token_bos());
+    std::vector<llama_token>  tmp(n_batch, llama_token_bos());
+    std::vector<llama_pos>    pos(n_batch);
+    std::vector<llama_seq_id> seq_id(n_batch, 0);
+
+    // pretend that n_ctx tokens of sequence 0 are already cached
+    if (!llama_kv_cache_reserve(ctx->model.hparams, ctx->kv_self, n_ctx + n_batch)) {
+        fprintf(stderr, "%s: the KV cache cannot hold %d tokens\n", __func__, n_ctx + n_batch);
+        return 1;
+    }
+
+    for (int i = 0; i < (int) ctx->kv_self.cells.size(); ++i) {
+        ctx->kv_self.cells[i].seq_id.clear();
+        ctx->kv_self.cells[i].pos = -1;
+        if (i < n_ctx) {
+            ctx->kv_self.cells[i].seq_id.insert(0);
+            ctx->kv_self.cells[i].pos = i;
+        }
+    }
+
+    llama_kv_cache_update_n(ctx->kv_self);
+
+    for (int i = 0; i < n_batch; ++i) {
+        pos[i] = n_ctx + i;
+    }
+
+    const llama_batch batch = { n_batch, tmp.data(), pos.data(), seq_id.data(), nullptr };
+
+    if (!llama_eval_internal(*ctx, batch, 1, fname)) {
+        fprintf(stderr, "%s: failed to eval\n", __func__);
+        return 1;
+    }
+
+    return 0;
+}
+
+struct llama_batch llama_batch_init(int32_t n_tokens) {
+    llama_batch batch;
+
+    batch.n_tokens = 0;
+    batch.token    = (llama_token  *) malloc(sizeof(llama_token)  * n_tokens);
+    batch.pos      = (llama_pos    *) malloc(sizeof(llama_pos)    * n_tokens);
+    batch.seq_id   = (llama_seq_id *) malloc(sizeof(llama_seq_id) * n_tokens);
+    batch.logits   = (int8_t       *) malloc(sizeof(int8_t)       * n_tokens);
+
+    return batch;
+}
+
+void llama_batch_free(struct llama_batch batch) {
+    free(batch.token);
+    free(batch.pos);
+    free(batch.seq_id);
+    free(batch.logits);
+}
 
-    if (!llama_eval_internal(*ctx, tmp.data(), tmp.size(), n_ctx, 1, fname)) {
+int llama_eval_batch(
+        struct llama_context * ctx,
+          struct llama_batch   batch,
+                         int   n_threads) {
+    if (!llama_eval_internal(*ctx, batch, n_threads, nullptr)) {
         fprintf(stderr, "%s: failed to eval\n", __func__);
         return 1;
     }
 
+    // get a more accurate load time, upon first eval
+    // TODO: fix this
+    if (!ctx->has_evaluated_once) {
+        ctx->t_load_us = ggml_time_us() - ctx->t_start_us;
+        ctx->has_evaluated_once = true;
+    }
+
     return 0;
 }
 
+int llama_get_eval_n_threads(const struct llama_context * ctx) {
+    return ctx->n_threads_eval;
+}
+
 int llama_tokenize(
         struct llama_context * ctx,
                   const char * text,
@@ -3499,6 +5159,17 @@ float * llama_get_logits(struct llama_context * ctx) {
     return ctx->logits.data();
 }
 
+float * llama_get_logits_ith(struct llama_context * ctx, int32_t i) {
+    LLAMA_ASSERT(i >= 0 && i < (int32_t) ctx->logits_rows.size());
+
+    const int32_t row = ctx->logits_rows[i];
+    if (row < 0) {
+        return nullptr;
+    }
+
+    return ctx->logits.data() + row*ctx->model.hparams.n_vocab;
+}
+
 float * llama_get_embeddings(struct llama_context * ctx) {
     return ctx->embedding.data();
 }
@@ -3524,6 +5195,15 @@ llama_token llama_token_nl() {
 }
 
 
+void llama_draft_record(struct llama_context * ctx, int n_draft, int n_accept, int64_t t_us) {
+    LLAMA_ASSERT(0 <= n_accept && n_accept <= n_draft);
+
+    ctx->t_draft_us     += t_us;
+    ctx->n_draft_step   += 1;
+    ctx->n_draft_token  += n_draft;
+    ctx->n_draft_accept += n_accept;
+}
+
 void llama_print_timings(struct llama_context * ctx) {
     const int64_t t_end_us = ggml_time_us();
 
@@ -3539,6 +5219,14 @@ void llama_print_timings(struct llama_context * ctx) {
             __func__, 1e-3 * ctx->t_p_eval_us, n_p_eval, 1e-3 * ctx->t_p_eval_us / n_p_eval, 1e6 / ctx->t_p_eval_us * n_p_eval);
     fprintf(stderr, "%s:        eval time = %8.2f ms / %5d runs   (%8.2f ms per token, %8.2f tokens per second)\n",
             __func__, 1e-3 * ctx->t_eval_us,   n_eval,   1e-3 * ctx->t_eval_us   / n_eval,   1e6 / ctx->t_eval_us   * n_eval);
+    fprintf(stderr, "%s:      graph cache = %8d hits / %5d misses\n", __func__, ctx->n_graph_hit, ctx->n_graph_miss);
+    if (ctx->n_draft_step > 0) {
+        const int32_t n_gen = ctx->n_draft_accept + ctx->n_draft_step;
+        fprintf(stderr, "%s:      draft steps = %8d steps / %5d drafted  (%8.2f %% accepted, %5.2f tokens per step)\n",
+                __func__, ctx->n_draft_step, ctx->n_draft_token, 100.0 * ctx->n_draft_accept / std::max(1, ctx->n_draft_token), (double) n_gen / ctx->n_draft_step);
+        fprintf(stderr, "%s:  speculative time = %8.2f ms / %5d tokens (%8.2f ms per token, %8.2f tokens per second)\n",
+                __func__, 1e-3 * ctx->t_draft_us, n_gen, 1e-3 * ctx->t_draft_us / n_gen, 1e6 / ctx->t_draft_us * n_gen);
+    }
     fprintf(stderr, "%s:       total time = %8.2f ms\n", __func__, (t_end_us - ctx->t_start_us)/1000.0);
 }
 
@@ -3547,6 +5235,10 @@ void llama_reset_timings(struct llama_context * ctx) {
     ctx->t_sample_us = ctx->n_sample = 0;
     ctx->t_eval_us   = ctx->n_eval   = 0;
     ctx->t_p_eval_us = ctx->n_p_eval = 0;
+
+    ctx->n_graph_hit = ctx->n_graph_miss = 0;
+
+    ctx->t_draft_us = ctx->n_draft_step = ctx->n_draft_token = ctx->n_draft_accept = 0;
 }
 
 const char * llama_print_system_info(void) {
@@ -3567,6 +5259,7 @@ const char * llama_print_system_info(void) {
     s += "BLAS = "        + std::to_string(ggml_cpu_has_blas())        + " | ";
     s += "SSE3 = "        + std::to_string(ggml_cpu_has_sse3())        + " | ";
     s += "VSX = "         + std::to_string(ggml_cpu_has_vsx())         + " | ";
+    s += "CPU_TIER = "    + std::string(ggml_cpu_tier())               + " | ";
 
     return s.c_str();
 }
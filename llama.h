@@ -39,12 +39,15 @@
 #define LLAMA_FILE_MAGIC_GGMF        0x67676d66u // 'ggmf'
 #define LLAMA_FILE_MAGIC_GGML        0x67676d6cu // 'ggml'
 #define LLAMA_FILE_MAGIC_GGSN        0x6767736eu // 'ggsn'
+#define LLAMA_FILE_MAGIC_GGRP        0x67677270u // 'ggrp'
 
 #define LLAMA_FILE_VERSION           3
 #define LLAMA_FILE_MAGIC             LLAMA_FILE_MAGIC_GGJT
 #define LLAMA_FILE_MAGIC_UNVERSIONED LLAMA_FILE_MAGIC_GGML
 #define LLAMA_SESSION_MAGIC          LLAMA_FILE_MAGIC_GGSN
-#define LLAMA_SESSION_VERSION        1
+#define LLAMA_SESSION_VERSION        7
+#define LLAMA_REPACK_MAGIC           LLAMA_FILE_MAGIC_GGRP
+#define LLAMA_REPACK_VERSION         1
 
 #if defined(GGML_USE_CUBLAS) || defined(GGML_USE_CLBLAST) || defined(GGML_USE_METAL)
 // Defined when llama.cpp is compiled with support for offloading model layers to GPU.
@@ -65,6 +68,8 @@ extern "C" {
     struct llama_context;
 
     typedef int llama_token;
+    typedef int llama_pos;
+    typedef int llama_seq_id;
 
     typedef struct llama_token_data {
         llama_token id; // token id
@@ -80,10 +85,24 @@ extern "C" {
 
     typedef void (*llama_progress_callback)(float progress, void *ctx);
 
+    // Input data for llama_eval_batch
+    // Each token carries its own position and sequence id, so tokens belonging to
+    // several independent sequences can be evaluated together in a single call
+    typedef struct llama_batch {
+        int32_t n_tokens;
+
+        llama_token  * token;
+        llama_pos    * pos;
+        llama_seq_id * seq_id;
+        int8_t       * logits; // if not NULL, the logits are computed only for the tokens with logits[i] != 0
+    } llama_batch;
+
    struct llama_context_params {
         int seed;                              // RNG seed, -1 for random
         int n_ctx;                             // text context
         int n_batch;                           // prompt processing batch size
+        int n_threads;                         // threads for the evals of a single token, 0 to use the n_threads of the eval call
+        int n_threads_batch;                   // threads for the evals of more tokens, 0 to use the n_threads of the eval call
         int n_gpu_layers;                      // number of layers to store in VRAM
         int main_gpu;                          // the GPU that is used for scratch and small tensors
         float tensor_split[LLAMA_MAX_DEVICES]; // how to split layers across multiple GPUs
@@ -92,14 +111,22 @@ extern "C" {
         // context pointer passed to the progress callback
         void * progress_callback_user_data;
 
+        enum ggml_type type_k; // data type for the K cache: F32, F16, Q8_0 or Q4_0
+        enum ggml_type type_v; // data type for the V cache: F32, F16, Q8_0 or Q4_0
+
         // Keep the booleans together to avoid misalignment during copy-by-value.
         bool low_vram;   // if true, reduce VRAM usage at the cost of performance
-        bool f16_kv;     // use fp16 for KV cache
+        bool f16_kv;     // deprecated, use type_k and type_v - false replaces an F16 type_k / type_v with F32
         bool logits_all; // the llama_eval() call computes all logits, not just the last one
         bool vocab_only; // only load the vocabulary, no weights
         bool use_mmap;   // use mmap if possible
         bool use_mlock;  // force system to keep model in RAM
         bool embedding;  // embedding mode only
+        bool flash_attn; // use the fused attention op, CPU only - ignored when the attention is offloaded
+        bool repack;     // repack the CPU weights into interleaved rows for the matrix multiplication, cached in <model>.repack
+        bool concat_weights; // concatenate wq, wk, wv and w1, w3 of the CPU layers to multiply each group as one matrix
+        bool v_rows;     // store the V cache like K, one contiguous row per cell - ignored when V is offloaded to the GPU
+        bool calibrate;  // measure on this host the cost model that picks the threads of each graph node (ggml_calibrate_cost_model)
     };
     // model file types
     enum llama_ftype {
@@ -195,11 +222,45 @@ extern "C" {
     // Returns the number of tokens in the KV cache
     LLAMA_API int llama_get_kv_cache_token_count(const struct llama_context * ctx);
 
+    // Removes all tokens of sequence seq_id with positions in [p0, p1) from the KV cache
+    // The storage of the cache is reduced when at most a quarter of it is still used
+    // p0 < 0 : [0,  p1)
+    // p1 < 0 : [p0, inf)
+    LLAMA_API void llama_kv_cache_seq_rm(
+            struct llama_context * ctx,
+                    llama_seq_id   seq_id,
+                       llama_pos   p0,
+                       llama_pos   p1);
+
+    // Adds delta to the positions of the tokens of sequence seq_id in [p0, p1)
+    // The cached keys are re-rotated to their new positions at the start of the next eval, so
+    // dropping a range with llama_kv_cache_seq_rm and shifting the rest down does not need a re-eval
+    // Tokens shared with other sequences are copied first (copy-on-write), the other sequences keep them as they are
+    // p0 < 0 : [0,  p1)
+    // p1 < 0 : [p0, inf)
+    LLAMA_API void llama_kv_cache_seq_shift(
+            struct llama_context * ctx,
+                    llama_seq_id   seq_id,
+                       llama_pos   p0,
+                       llama_pos   p1,
+                       llama_pos   delta);
+
+    // Makes the tokens of sequence seq_id_src with positions in [p0, p1) also belong to seq_id_dst
+    // The cached K and V data is shared, not copied, so a common prompt prefix is stored once
+    // p0 < 0 : [0,  p1)
+    // p1 < 0 : [p0, inf)
+    LLAMA_API void llama_kv_cache_seq_cp(
+            struct llama_context * ctx,
+                    llama_seq_id   seq_id_src,
+                    llama_seq_id   seq_id_dst,
+                       llama_pos   p0,
+                       llama_pos   p1);
+
     // Sets the current rng seed.
     LLAMA_API void llama_set_rng_seed(struct llama_context * ctx, int seed);
 
     // Returns the maximum size in bytes of the state (rng, logits, embedding
-    // and kv_cache) - will often be smaller after compacting tokens
+    // and kv_cache with the positions and sequences of its cells) - will often be smaller after compacting tokens
     LLAMA_API size_t llama_get_state_size(const struct llama_context * ctx);
 
     // Copies the state to the specified destination address.
@@ -208,7 +269,8 @@ extern "C" {
     LLAMA_API size_t llama_copy_state_data(struct llama_context * ctx, uint8_t * dst);
 
     // Set the state reading from the specified address
-    // Returns the number of bytes read
+    // Returns the number of bytes read, or 0 if the types or the V layout of the KV cache of the state don't match the context
+    // or its cells cannot be allocated
     LLAMA_API size_t llama_set_state_data(struct llama_context * ctx, uint8_t * src);
 
     // Save/load session file
@@ -218,6 +280,7 @@ extern "C" {
     // Run the llama inference to obtain the logits and probabilities for the next token.
     // tokens + n_tokens is the provided batch of new tokens to process
     // n_past is the number of tokens to use from previous eval calls
+    // The tokens are evaluated as sequence 0 - any cached tokens of it at positions >= n_past are discarded
     // Returns 0 on success
     LLAMA_API int llama_eval(
             struct llama_context * ctx,
@@ -226,6 +289,26 @@ extern "C" {
                              int   n_past,
                              int   n_threads);
 
+    // Allocates a batch that can hold up to n_tokens tokens
+    // The returned batch has n_tokens set to 0 and must be freed with llama_batch_free()
+    LLAMA_API struct llama_batch llama_batch_init(int32_t n_tokens);
+
+    LLAMA_API void llama_batch_free(struct llama_batch batch);
+
+    // Run the llama inference on a batch of tokens from one or more sequences.
+    // A token attends to the cached tokens of the same sequence at positions <= its own.
+    // Logits are computed for the tokens selected by batch.logits, or as with llama_eval() if it is NULL.
+    // Returns 0 on success
+    // Returns 1 on failure, e.g. when there is no room left in the KV cache for the batch
+    LLAMA_API int llama_eval_batch(
+            struct llama_context * ctx,
+              struct llama_batch   batch,
+                             int   n_threads);
+
+    // Returns the number of threads of the last eval: the n_threads of the context for a single token,
+    // its n_threads_batch for more tokens, or the n_threads of the eval call if the one of the context is 0
+    LLAMA_API int llama_get_eval_n_threads(const struct llama_context * ctx);
+
     // Export a static computation graph for context of 511 and batch size of 1
     // NOTE: since this functionality is mostly for debugging and demonstration purposes, we hardcode these
     //       parameters here to keep things simple
@@ -259,10 +342,15 @@ extern "C" {
     // Token logits obtained from the last call to llama_eval()
     // The logits for the last token are stored in the last row
     // Can be mutated in order to change the probabilities of the next token
-    // Rows: n_tokens
+    // Rows: number of tokens with logits - n_tokens if logits_all, 1 otherwise,
+    //       or the tokens selected by llama_batch.logits, in batch order
     // Cols: n_vocab
     LLAMA_API float * llama_get_logits(struct llama_context * ctx);
 
+    // Logits of the i-th token of the last batch
+    // Returns NULL if the logits of that token were not computed
+    LLAMA_API float * llama_get_logits_ith(struct llama_context * ctx, int32_t i);
+
     // Get the embeddings for the input
     // shape: [n_embd] (1-dimensional)
     LLAMA_API float * llama_get_embeddings(struct llama_context * ctx);
@@ -320,6 +408,17 @@ extern "C" {
     /// @details Randomly selects a token from the candidates based on their probabilities.
     LLAMA_API llama_token llama_sample_token(struct llama_context * ctx, llama_token_data_array * candidates);
 
+    // Speculative decoding
+    // Records one step on the target context: n_draft tokens proposed by a draft model were verified in one batch
+    // and the first n_accept of them were kept, so the step produced n_accept + 1 tokens in t_us microseconds
+    // (drafting and verification). The rejected tokens are rolled back with llama_kv_cache_seq_rm
+    // The acceptance rate and the effective tokens per second are reported by llama_print_timings
+    LLAMA_API void llama_draft_record(
+            struct llama_context * ctx,
+                             int   n_draft,
+                             int   n_accept,
+                         int64_t   t_us);
+
     // Performance information
     LLAMA_API void llama_print_timings(struct llama_context * ctx);
     LLAMA_API void llama_reset_timings(struct llama_context * ctx);
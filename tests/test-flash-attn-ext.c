@@ -0,0 +1,232 @@
+// compare the forward pass of ggml_flash_attn_ext with the unfused KQ / soft_max / KQV chain that llama builds without it
+#include "ggml.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define MAX_ERR 2e-3f
+
+static float frand(void) {
+    return (float)rand()/(float)RAND_MAX;
+}
+
+static void fill_random(float * x, int64_t n) {
+    for (int64_t i = 0; i < n; i++) {
+        x[i] = 2.0f*frand() - 1.0f;
+    }
+}
+
+// store n floats as type, the rows of the tensor are contiguous
+static void set_data(struct ggml_tensor * t, const float * x, int64_t n) {
+    switch (t->type) {
+        case GGML_TYPE_F32:
+            {
+                memcpy(t->data, x, n*sizeof(float));
+            } break;
+        case GGML_TYPE_F16:
+            {
+                ggml_fp32_to_fp16_row(x, (ggml_fp16_t *) t->data, n);
+            } break;
+        default:
+            {
+                int64_t hist[16];
+                ggml_quantize_chunk(t->type, x, t->data, 0, (int) n, hist);
+            } break;
+    }
+}
+
+struct test_case {
+    int64_t D;       // head size
+    int64_t N;       // query rows, 1 for the split-KV decode path
+    int64_t n_kv;    // cells
+    int64_t H;       // heads
+    enum ggml_type type_k;
+    enum ggml_type type_v;
+    bool v_trans;    // V stored with the cells contiguous
+    bool masked;
+};
+
+// returns the max abs difference to the unfused chain relative to the max abs value of its result
+static float test_flash_attn_ext(const struct test_case * tc, int n_threads) {
+    const int64_t D    = tc->D;
+    const int64_t N    = tc->N;
+    const int64_t n_kv = tc->n_kv;
+    const int64_t H    = tc->H;
+
+    struct ggml_init_params params = {
+        /* .mem_size   = */ 256*1024*1024,
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ false,
+    };
+
+    struct ggml_context * ctx = ggml_init(params);
+
+    float * data = malloc(sizeof(float)*D*H*MAX(N, n_kv));
+
+    // Q: [D, N, H] as llama has it after the permute of Qcur
+    struct ggml_tensor * Q = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, D, N, H);
+    fill_random((float *) Q->data, D*N*H);
+
+    // K: the cells of the cache, [D*H, n_kv] split into heads
+    struct ggml_tensor * k_cache = ggml_new_tensor_3d(ctx, tc->type_k, D, H, n_kv);
+    fill_random(data, D*H*n_kv);
+    set_data(k_cache, data, D*H*n_kv);
+
+    struct ggml_tensor * K = ggml_permute(ctx, k_cache, 0, 2, 1, 3);
+
+    // V: [D, n_kv, H] for flash_attn_ext, either split from the rows of the cells or transposed
+    struct ggml_tensor * v_cache;
+    struct ggml_tensor * V;
+    fill_random(data, D*H*n_kv);
+    if (tc->v_trans) {
+        v_cache = ggml_new_tensor_3d(ctx, tc->type_v, n_kv, D, H);
+        set_data(v_cache, data, D*H*n_kv);
+        V = ggml_transpose(ctx, v_cache);
+    } else {
+        v_cache = ggml_new_tensor_3d(ctx, tc->type_v, D, H, n_kv);
+        set_data(v_cache, data, D*H*n_kv);
+        V = ggml_permute(ctx, v_cache, 0, 2, 1, 3);
+    }
+
+    // the causal mask of the last N cells, plus some cells of the past that are masked out, cell 0 is always visible
+    struct ggml_tensor * mask = NULL;
+    if (tc->masked) {
+        mask = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_kv, N);
+        float * m = (float *) mask->data;
+        for (int64_t i1 = 0; i1 < N; i1++) {
+            for (int64_t i0 = 0; i0 < n_kv; i0++) {
+                const bool future = i0 > n_kv - N + i1;
+                const bool hidden = i0 > 0 && (i0*7 + i1*3) % 5 == 0;
+                m[i1*n_kv + i0] = future || hidden ? -INFINITY : 0.0f;
+            }
+        }
+    }
+
+    const float scale = 1.0f/sqrtf((float) D);
+
+    // res: [D, H, N]
+    struct ggml_tensor * res = ggml_flash_attn_ext(ctx, Q, K, V, mask, scale);
+
+    // the unfused chain: KQ is [n_kv, N, H], KQV is [D, N, H]
+    struct ggml_tensor * KQ = ggml_mul_mat(ctx, K, Q);
+    KQ = ggml_scale_inplace(ctx, KQ, ggml_new_f32(ctx, scale));
+    if (mask) {
+        KQ = ggml_add_inplace(ctx, KQ, mask);
+    }
+    KQ = ggml_soft_max_inplace(ctx, KQ);
+
+    struct ggml_tensor * KQV = tc->v_trans
+        ? ggml_mul_mat(ctx, v_cache, KQ)
+        : ggml_out_prod(ctx, V, ggml_transpose(ctx, KQ));
+
+    struct ggml_cgraph gf = ggml_build_forward(res);
+    ggml_build_forward_expand(&gf, KQV);
+    gf.n_threads = n_threads;
+
+    // the split of the cells across the threads only happens when the cost model gives the node all the threads
+    struct ggml_cost_model cost_model = ggml_cost_model_default();
+    cost_model.task_us = 0.0f;
+    gf.cost_model = &cost_model;
+
+    ggml_graph_compute(ctx, &gf);
+
+    float err = 0.0f;
+    float ref = 0.0f;
+    for (int64_t ih = 0; ih < H; ih++) {
+        for (int64_t iq = 0; iq < N; iq++) {
+            for (int64_t id = 0; id < D; id++) {
+                const float r = *(float *) ((char *) KQV->data + id*KQV->nb[0] + iq*KQV->nb[1] + ih*KQV->nb[2]);
+                const float x = *(float *) ((char *) res->data + id*res->nb[0] + ih*res->nb[1] + iq*res->nb[2]);
+                assert(isfinite(x));
+                err = MAX(err, fabsf(x - r));
+                ref = MAX(ref, fabsf(r));
+            }
+        }
+    }
+
+    free(data);
+    ggml_free(ctx);
+
+    return err/MAX(ref, 1e-6f);
+}
+
+int main(void) {
+    srand(0);
+
+    const int64_t shapes[][4] = {
+        // D, N, n_kv, H
+        {  32,  1,    1, 1 },
+        {  64,  1,   33, 2 },
+        { 128,  1,  300, 4 },
+        {  64,  1, 1024, 2 },
+        {  32,  7,   40, 2 },
+        {  64, 32,   32, 4 },
+        { 128, 17,  300, 2 },
+        {  64, 64,  520, 2 },
+    };
+
+    const struct {
+        enum ggml_type type_k;
+        enum ggml_type type_v;
+        bool v_trans;
+    } types[] = {
+        { GGML_TYPE_F32,  GGML_TYPE_F32,  false },
+        { GGML_TYPE_F32,  GGML_TYPE_F32,  true  },
+        { GGML_TYPE_F16,  GGML_TYPE_F16,  false },
+        { GGML_TYPE_F16,  GGML_TYPE_F16,  true  },
+        { GGML_TYPE_Q8_0, GGML_TYPE_Q8_0, false },
+        { GGML_TYPE_Q4_0, GGML_TYPE_Q4_0, false },
+        { GGML_TYPE_Q8_0, GGML_TYPE_F16,  true  },
+        { GGML_TYPE_Q4_0, GGML_TYPE_F16,  false },
+        { GGML_TYPE_F16,  GGML_TYPE_Q8_0, false },
+        { GGML_TYPE_F16,  GGML_TYPE_Q4_0, false },
+    };
+
+    const int threads[] = { 1, 4 };
+
+    int n_fail = 0;
+    int n_test = 0;
+
+    for (size_t is = 0; is < sizeof(shapes)/sizeof(shapes[0]); is++) {
+        for (size_t it = 0; it < sizeof(types)/sizeof(types[0]); it++) {
+            // the quantized dot products take an even number of blocks
+            if (ggml_is_quantized(types[it].type_k) && shapes[is][0] % (2*ggml_blck_size(types[it].type_k)) != 0) {
+                continue;
+            }
+            for (int masked = 0; masked < 2; masked++) {
+                for (size_t ith = 0; ith < sizeof(threads)/sizeof(threads[0]); ith++) {
+                    const struct test_case tc = {
+                        /* .D       = */ shapes[is][0],
+                        /* .N       = */ shapes[is][1],
+                        /* .n_kv    = */ shapes[is][2],
+                        /* .H       = */ shapes[is][3],
+                        /* .type_k  = */ types[it].type_k,
+                        /* .type_v  = */ types[it].type_v,
+                        /* .v_trans = */ types[it].v_trans,
+                        /* .masked  = */ masked != 0,
+                    };
+
+                    const float err = test_flash_attn_ext(&tc, threads[ith]);
+
+                    n_test++;
+                    if (!(err < MAX_ERR)) {
+                        n_fail++;
+                        printf("FAIL: D = %3d, N = %2d, n_kv = %4d, H = %d, K %-4s, V %-4s%s%s, %d threads: err = %e\n",
+                                (int) tc.D, (int) tc.N, (int) tc.n_kv, (int) tc.H,
+                                ggml_type_name(tc.type_k), ggml_type_name(tc.type_v), tc.v_trans ? " transposed" : "",
+                                tc.masked ? ", masked" : "", threads[ith], (double) err);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%d/%d tests passed\n", n_test - n_fail, n_test);
+
+    return n_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+// check the number of threads that ggml_graph_plan gives the nodes of a graph under ggml_cost_model_default(),
+// and that ggml_calibrate_cost_model measures a usable model for the types of the weights
+#include "ggml.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+// the plan only looks at the shapes and types, so the tensors have no data
+static struct ggml_context * make_ctx(void) {
+    struct ggml_init_params params = {
+        /* .mem_size   = */ 16*1024*1024,
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ true,
+    };
+
+    return ggml_init(params);
+}
+
+static bool check(const char * name, const struct ggml_tensor * node, int n_tasks) {
+    if (node->n_tasks != n_tasks) {
+        printf("FAIL: %s: n_tasks = %d, expected %d\n", name, node->n_tasks, n_tasks);
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    const int n_threads = 8;
+
+    const struct ggml_cost_model cost_model = ggml_cost_model_default();
+
+    int n_fail = 0;
+    int n_test = 0;
+
+    // a tiny node costs less than waking up a second thread, a large product is worth all of them
+    {
+        struct ggml_context * ctx = make_ctx();
+
+        struct ggml_tensor * x = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 16);
+        struct ggml_tensor * y = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 16);
+        struct ggml_tensor * add = ggml_add(ctx, x, y);
+
+        // the product of the decode of one token with a 4096x4096 Q4_0 weight
+        struct ggml_tensor * w = ggml_new_tensor_2d(ctx, GGML_TYPE_Q4_0, 4096, 4096);
+        struct ggml_tensor * b = ggml_new_tensor_2d(ctx, GGML_TYPE_F32,  4096, 1);
+        struct ggml_tensor * mm_q = ggml_mul_mat(ctx, w, b);
+
+        // the same product with an F32 weight
+        struct ggml_tensor * wf = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, 4096, 4096);
+        struct ggml_tensor * mm_f = ggml_mul_mat(ctx, wf, b);
+
+        struct ggml_cgraph gf = ggml_build_forward(add);
+        ggml_build_forward_expand(&gf, mm_q);
+        ggml_build_forward_expand(&gf, mm_f);
+        gf.n_threads  = n_threads;
+        gf.cost_model = &cost_model;
+
+        ggml_graph_plan(&gf);
+
+        n_test += 3;
+        n_fail += !check("tiny add",     add,  1);
+        n_fail += !check("Q4_0 mul_mat", mm_q, n_threads);
+        n_fail += !check("F32 mul_mat",  mm_f, n_threads);
+
+        // a single thread plans every node on it
+        gf.n_threads = 1;
+        ggml_graph_plan(&gf);
+
+        n_test += 1;
+        n_fail += !check("1 thread mul_mat", mm_q, 1);
+
+        ggml_free(ctx);
+    }
+
+    // a model without a cost for the threads gives every node all of them
+    {
+        struct ggml_context * ctx = make_ctx();
+
+        struct ggml_tensor * x = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 16);
+        struct ggml_tensor * y = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 16);
+        struct ggml_tensor * add = ggml_add(ctx, x, y);
+
+        struct ggml_cost_model cost_model_n = cost_model;
+        cost_model_n.task_us = 0.0f;
+
+        struct ggml_cgraph gf = ggml_build_forward(add);
+        gf.n_threads  = n_threads;
+        gf.cost_model = &cost_model_n;
+
+        ggml_graph_plan(&gf);
+
+        n_test += 1;
+        n_fail += !check("tiny add, no thread cost", add, n_threads);
+
+        ggml_free(ctx);
+    }
+
+    // the calibration measures the products with quantized, interleaved and unsupported types of src0
+    {
+        const enum ggml_type types[] = { GGML_TYPE_F32, GGML_TYPE_Q4_0, GGML_TYPE_Q4_0_X4, GGML_TYPE_I32 };
+
+        for (size_t it = 0; it < sizeof(types)/sizeof(types[0]); it++) {
+            const struct ggml_cost_model model = ggml_calibrate_cost_model(NULL, types[it]);
+
+            n_test++;
+            if (!(model.flops_per_us > 0.0f && isfinite(model.flops_per_us) && model.bytes_per_us > 0.0f && isfinite(model.bytes_per_us))) {
+                n_fail++;
+                printf("FAIL: calibration with %s: %f flops/us, %f bytes/us\n", ggml_type_name(types[it]),
+                        (double) model.flops_per_us, (double) model.bytes_per_us);
+            }
+        }
+    }
+
+    printf("%d/%d tests passed\n", n_test - n_fail, n_test);
+
+    return n_fail > 0 ? 1 : 0;
+}
@@ -6,6 +6,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -18,6 +19,8 @@ const float MAX_QUANTIZATION_TOTAL_ERROR = 0.002f;
 const float MAX_QUANTIZATION_TOTAL_ERROR_2BITS = 0.0075f;
 const float MAX_QUANTIZATION_TOTAL_ERROR_3BITS = 0.0040f;
 const float MAX_DOT_PRODUCT_ERROR = 0.02f;
+const float MAX_DOT_PRODUCT_REFERENCE_ERROR = 0.00001f;
+const float MAX_DOT_PRODUCT_TILE_ERROR = 0.00001f;
 
 const char* RESULT_STR[] = {"ok", "FAILED"};
 
@@ -88,6 +91,84 @@ float dot_product_error(quantize_fns_t & qfns, size_t test_size, const float * t
     return fabsf(result - dot_ref) / test_size;
 }
 
+// Dot product error against the scalar dot product of the dequantized rows, the SIMD kernels only differ from it
+// by the order of the float operations
+float dot_product_reference_error(quantize_fns_t & qfns, size_t test_size, const float * test_data1, const float *test_data2) {
+    quantize_fns_t qfns_dot = ggml_internal_get_quantize_fn(qfns.vec_dot_type);
+
+    std::vector<uint8_t> tmp_q1(2*test_size);
+    std::vector<uint8_t> tmp_q2(2*test_size);
+    std::vector<float> tmp_out1(test_size);
+    std::vector<float> tmp_out2(test_size);
+
+    qfns.quantize_row_q    (test_data1, tmp_q1.data(), test_size);
+    qfns.quantize_row_q_dot(test_data2, tmp_q2.data(), test_size);
+
+    float result = INFINITY;
+    qfns.vec_dot_q(test_size, &result, tmp_q1.data(), tmp_q2.data());
+
+    qfns.dequantize_row_q    (tmp_q1.data(), tmp_out1.data(), test_size);
+    qfns_dot.dequantize_row_q(tmp_q2.data(), tmp_out2.data(), test_size);
+
+    const float dot_ref = dot_product(tmp_out1.data(), tmp_out2.data(), test_size);
+
+    return fabsf(result - dot_ref) / test_size;
+}
+
+// Largest difference between the tiled dot products and vec_dot_q, for all the numbers of columns of the tile
+// the rows of x are repacked to repack_type first unless it is GGML_TYPE_COUNT
+float dot_product_tile_error(ggml_type type, quantize_fns_t & qfns, size_t test_size, ggml_type repack_type) {
+    const size_t nx = GGML_VEC_DOT_Q_TILE_NX;
+    const size_t ny = GGML_VEC_DOT_Q_TILE_NY;
+
+    const size_t row_size = 2*test_size;
+
+    std::vector<float> tmp_data(test_size);
+    std::vector<uint8_t> tmp_qx(nx*row_size);
+    std::vector<uint8_t> tmp_qy(ny*row_size);
+    std::vector<uint8_t> tmp_qr(nx*row_size);
+
+    for (size_t i = 0; i < nx; i++) {
+        generate_data(2.0 + i, test_size, tmp_data.data());
+        qfns.quantize_row_q(tmp_data.data(), tmp_qx.data() + i*row_size, test_size);
+    }
+    for (size_t j = 0; j < ny; j++) {
+        generate_data(10.0 + j, test_size, tmp_data.data());
+        qfns.quantize_row_q_dot(tmp_data.data(), tmp_qy.data() + j*row_size, test_size);
+    }
+
+    vec_dot_q_tile_t vec_dot_q_tile = qfns.vec_dot_q_tile;
+    const uint8_t * qx = tmp_qx.data();
+    size_t bx = row_size;
+
+    if (repack_type != GGML_TYPE_COUNT) {
+        // the repacked rows are contiguous
+        bx = test_size*ggml_type_size(type)/ggml_blck_size(type);
+        for (size_t i = 0; i < nx; i++) {
+            memcpy(tmp_qr.data() + i*bx, tmp_qx.data() + i*row_size, bx);
+        }
+        ggml_repack(type, tmp_qr.data(), tmp_qx.data(), nx, test_size);
+        vec_dot_q_tile = ggml_internal_get_quantize_fn(repack_type).vec_dot_q_tile;
+    }
+
+    float max_error = 0.0f;
+    for (size_t n = 1; n <= ny; n++) {
+        std::vector<float> result(nx*n, INFINITY);
+        vec_dot_q_tile(test_size, result.data(), nx, qx, bx, tmp_qy.data(), row_size, n);
+
+        for (size_t j = 0; j < n; j++) {
+            for (size_t i = 0; i < nx; i++) {
+                float dot = INFINITY;
+                const uint8_t * row = repack_type != GGML_TYPE_COUNT ? tmp_qr.data() + i*bx : tmp_qx.data() + i*row_size;
+                qfns.vec_dot_q(test_size, &dot, row, tmp_qy.data() + j*row_size);
+                max_error = fmaxf(max_error, fabsf(result[j*nx + i] - dot) / test_size);
+            }
+        }
+    }
+
+    return max_error;
+}
+
 int main(int argc, char * argv[]) {
     bool verbose = false;
     const size_t test_size = 32 * 128;
@@ -143,11 +224,39 @@ int main(int argc, char * argv[]) {
                 printf("%5s reference implementation error: %s (%f)\n", ggml_type_name(type), RESULT_STR[failed], reference_error);
             }
 
-            const float vec_dot_error = dot_product_error(qfns, test_size, test_data.data(), test_data2.data());
-            failed = !(vec_dot_error < MAX_DOT_PRODUCT_ERROR);
-            num_failed += failed;
-            if (failed || verbose) {
-                printf("%5s dot product error:              %s (%f)\n", ggml_type_name(type), RESULT_STR[failed], vec_dot_error);
+            if (qfns.vec_dot_q) {
+                const float vec_dot_error = dot_product_error(qfns, test_size, test_data.data(), test_data2.data());
+                failed = !(vec_dot_error < MAX_DOT_PRODUCT_ERROR);
+                num_failed += failed;
+                if (failed || verbose) {
+                    printf("%5s dot product error:              %s (%f)\n", ggml_type_name(type), RESULT_STR[failed], vec_dot_error);
+                }
+
+                const float vec_dot_reference_error = dot_product_reference_error(qfns, test_size, test_data.data(), test_data2.data());
+                failed = !(vec_dot_reference_error < MAX_DOT_PRODUCT_REFERENCE_ERROR);
+                num_failed += failed;
+                if (failed || verbose) {
+                    printf("%5s dot product reference error:    %s (%f)\n", ggml_type_name(type), RESULT_STR[failed], vec_dot_reference_error);
+                }
+            }
+
+            if (qfns.vec_dot_q_tile) {
+                const float vec_dot_tile_error = dot_product_tile_error(type, qfns, test_size, GGML_TYPE_COUNT);
+                failed = !(vec_dot_tile_error < MAX_DOT_PRODUCT_TILE_ERROR);
+                num_failed += failed;
+                if (failed || verbose) {
+                    printf("%5s tiled dot product error:        %s (%f)\n", ggml_type_name(type), RESULT_STR[failed], vec_dot_tile_error);
+                }
+            }
+
+            const ggml_type repack_type = ggml_repack_type(type);
+            if (repack_type != GGML_TYPE_COUNT) {
+                const float vec_dot_tile_error = dot_product_tile_error(type, qfns, test_size, repack_type);
+                failed = !(vec_dot_tile_error < MAX_DOT_PRODUCT_TILE_ERROR);
+                num_failed += failed;
+                if (failed || verbose) {
+                    printf("%5s repacked dot product error:     %s (%f)\n", ggml_type_name(type), RESULT_STR[failed], vec_dot_tile_error);
+                }
             }
         }
     }
@@ -269,6 +269,9 @@ int main(int argc, char * argv[]) {
     };
     struct ggml_context * ctx = ggml_init(ggml_params);
 
+    // the kernels of the dispatched tier are benchmarked
+    printf("CPU tier: %s\n\n", ggml_cpu_tier());
+
     for (int i = 0; i < GGML_TYPE_COUNT; i++) {
         ggml_type type = (ggml_type) i;
         quantize_fns_t qfns = ggml_internal_get_quantize_fn(i);
@@ -336,10 +339,10 @@ int main(int argc, char * argv[]) {
                 printf("\n");
             }
 
-            if (params.op_vec_dot_q) {
+            if (params.op_vec_dot_q && qfns.vec_dot_q) {
                 printf("  vec_dot_q\n");
-                qfns.quantize_row_q(test_data1, test_q1, largest);
-                qfns.quantize_row_q(test_data2, test_q2, largest);
+                qfns.quantize_row_q    (test_data1, test_q1, largest);
+                qfns.quantize_row_q_dot(test_data2, test_q2, largest);
                 for (size_t size : params.test_sizes) {
                     printf("    %zu values (%.2f MB)\n", size, 4*size/(float)(1024*1024));
                     auto quantize_fn = [&](void ) {
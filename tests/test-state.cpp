@@ -0,0 +1,392 @@
+// save and restore the state of a context whose KV cache has grown past its initial size, and the threads of its evals
+// the model is a tiny llama with random weights that is written next to the test binary
+#include "llama.h"
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const uint32_t n_vocab = 64;
+static const uint32_t n_embd  = 256;
+static const uint32_t n_mult  = 32;
+static const uint32_t n_head  = 4;
+static const uint32_t n_layer = 4;
+
+static const int n_ctx    = 1024;
+static const int n_prompt = 590; // more than the first two sizes of the KV cache, 256 and 512 cells
+
+static uint32_t rng_state = 42;
+
+static float rand_weight(float scale) {
+    rng_state = rng_state*1664525u + 1013904223u;
+    return scale*(2.0f*(float) (rng_state >> 8)/(float) (1u << 24) - 1.0f);
+}
+
+static void write_u32(FILE * f, uint32_t v) {
+    fwrite(&v, sizeof(v), 1, f);
+}
+
+static void write_tensor(FILE * f, const std::string & name, const std::vector<uint32_t> & ne, float scale, float offset) {
+    write_u32(f, (uint32_t) ne.size());
+    write_u32(f, (uint32_t) name.size());
+    write_u32(f, 0); // GGML_TYPE_F32
+    for (uint32_t n : ne) {
+        write_u32(f, n);
+    }
+    fwrite(name.data(), 1, name.size(), f);
+
+    // the tensor data is aligned to 32 bytes in the ggjt format
+    const long pad = -ftell(f) & 31;
+    for (long i = 0; i < pad; ++i) {
+        fputc(0, f);
+    }
+
+    size_t n = 1;
+    for (uint32_t x : ne) {
+        n *= x;
+    }
+    std::vector<float> data(n);
+    for (auto & x : data) {
+        x = offset + rand_weight(scale);
+    }
+    fwrite(data.data(), sizeof(float), n, f);
+}
+
+static bool write_model(const char * fname) {
+    FILE * f = fopen(fname, "wb");
+    if (f == NULL) {
+        return false;
+    }
+
+    const uint32_t n_ff = ((2*(4*n_embd)/3 + n_mult - 1)/n_mult)*n_mult;
+
+    write_u32(f, 0x67676a74); // 'ggjt'
+    write_u32(f, 3);
+    write_u32(f, n_vocab);
+    write_u32(f, n_embd);
+    write_u32(f, n_mult);
+    write_u32(f, n_head);
+    write_u32(f, n_layer);
+    write_u32(f, n_embd/n_head);
+    write_u32(f, 0); // LLAMA_FTYPE_ALL_F32
+
+    for (uint32_t i = 0; i < n_vocab; ++i) {
+        const std::string text = "<" + std::to_string(i) + ">";
+        const float score = 0.0f;
+        write_u32(f, (uint32_t) text.size());
+        fwrite(text.data(), 1, text.size(), f);
+        fwrite(&score, sizeof(score), 1, f);
+    }
+
+    write_tensor(f, "tok_embeddings.weight", { n_embd, n_vocab }, 1.0f, 0.0f);
+    write_tensor(f, "norm.weight",           { n_embd },          0.1f, 1.0f);
+    write_tensor(f, "output.weight",         { n_embd, n_vocab }, 0.1f, 0.0f);
+
+    for (uint32_t il = 0; il < n_layer; ++il) {
+        const std::string prefix = "layers." + std::to_string(il) + ".";
+
+        write_tensor(f, prefix + "attention_norm.weight",  { n_embd },         0.1f, 1.0f);
+        write_tensor(f, prefix + "attention.wq.weight",    { n_embd, n_embd }, 0.2f, 0.0f);
+        write_tensor(f, prefix + "attention.wk.weight",    { n_embd, n_embd }, 0.2f, 0.0f);
+        write_tensor(f, prefix + "attention.wv.weight",    { n_embd, n_embd }, 0.2f, 0.0f);
+        write_tensor(f, prefix + "attention.wo.weight",    { n_embd, n_embd }, 0.2f, 0.0f);
+        write_tensor(f, prefix + "ffn_norm.weight",        { n_embd },         0.1f, 1.0f);
+        write_tensor(f, prefix + "feed_forward.w1.weight", { n_embd, n_ff },   0.2f, 0.0f);
+        write_tensor(f, prefix + "feed_forward.w2.weight", { n_ff, n_embd },   0.1f, 0.0f);
+        write_tensor(f, prefix + "feed_forward.w3.weight", { n_embd, n_ff },   0.2f, 0.0f);
+    }
+
+    fclose(f);
+
+    return true;
+}
+
+// evaluate the next token and return its logits
+static std::vector<float> eval_next(llama_context * ctx, llama_token token, int n_past) {
+    assert(llama_eval(ctx, &token, 1, n_past, 2) == 0);
+
+    const float * logits = llama_get_logits(ctx);
+
+    return std::vector<float>(logits, logits + n_vocab);
+}
+
+// evaluate the tokens of one sequence at the positions [pos0, pos0 + n) and return the logits of the last one
+static std::vector<float> eval_seq(llama_context * ctx, const llama_token * tokens, int n, int pos0, llama_seq_id seq_id) {
+    llama_batch batch = llama_batch_init(n);
+
+    for (int i = 0; i < n; ++i) {
+        batch.token [i] = tokens[i];
+        batch.pos   [i] = pos0 + i;
+        batch.seq_id[i] = seq_id;
+        batch.logits[i] = i == n - 1;
+    }
+    batch.n_tokens = n;
+
+    assert(llama_eval_batch(ctx, batch, 2) == 0);
+
+    llama_batch_free(batch);
+
+    const float * logits = llama_get_logits_ith(ctx, n - 1);
+    assert(logits != NULL);
+
+    return std::vector<float>(logits, logits + n_vocab);
+}
+
+// the graphs of the two contexts attend to different numbers of cells in a different order,
+// so the sums are not bit-identical (differences up to ~5e-4 with this model)
+static bool logits_close(const std::vector<float> & a, const std::vector<float> & b) {
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::fabs(a[i] - b[i]) > 2e-3f*std::max(1.0f, std::fabs(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    const char * fname_model   = "test-state-model.bin";
+    const char * fname_session = "test-state-session.bin";
+
+    if (!write_model(fname_model)) {
+        fprintf(stderr, "%s: error: failed to write '%s'\n", __func__, fname_model);
+        return 1;
+    }
+
+    llama_init_backend(false);
+
+    auto lparams = llama_context_default_params();
+
+    lparams.n_ctx     = n_ctx;
+    lparams.n_batch   = 512;
+    lparams.seed      = 1;
+    lparams.use_mmap  = false;
+    // large enough cells for the data of the cells past the initial size to exceed the slack of the cache buffer
+    lparams.type_k    = GGML_TYPE_F32;
+    lparams.type_v    = GGML_TYPE_F32;
+
+    llama_model * model = llama_load_model_from_file(fname_model, lparams);
+    assert(model != NULL);
+
+    std::vector<llama_token> tokens(n_prompt);
+    tokens[0] = llama_token_bos();
+    for (int i = 1; i < n_prompt; ++i) {
+        tokens[i] = 3 + (i*7) % (n_vocab - 3);
+    }
+
+    // the decode of a single token runs on n_threads, larger batches on n_threads_batch, and the n_threads of the
+    // call is only used when the context leaves them at 0
+    {
+        auto lparams_threads = lparams;
+        lparams_threads.n_threads       = 1;
+        lparams_threads.n_threads_batch = 3;
+
+        llama_context * ctx_threads = llama_new_context_with_model(model, lparams_threads);
+        assert(ctx_threads != NULL);
+
+        eval_seq(ctx_threads, tokens.data(), 8, 0, 0);
+        assert(llama_get_eval_n_threads(ctx_threads) == 3);
+
+        eval_seq(ctx_threads, tokens.data() + 8, 1, 8, 0);
+        assert(llama_get_eval_n_threads(ctx_threads) == 1);
+
+        llama_free(ctx_threads);
+
+        llama_context * ctx_call = llama_new_context_with_model(model, lparams);
+        assert(ctx_call != NULL);
+
+        eval_seq(ctx_call, tokens.data(), 8, 0, 0);
+        assert(llama_get_eval_n_threads(ctx_call) == 2);
+
+        llama_free(ctx_call);
+    }
+
+    // a prefix shared with llama_kv_cache_seq_cp is copied on write: shifting the copy of one sequence leaves the
+    // cells of the other one as they are, and the shifted sequence attends to the same keys as an unshared one
+    {
+        const int n_prefix = 64;
+
+        llama_context * ctx_cp = llama_new_context_with_model(model, lparams);
+        assert(ctx_cp != NULL);
+
+        eval_seq(ctx_cp, tokens.data(), n_prefix, 0, 0);
+        llama_kv_cache_seq_cp(ctx_cp, 0, 1, -1, -1);
+        llama_kv_cache_seq_rm   (ctx_cp, 1, 16, 32);
+        llama_kv_cache_seq_shift(ctx_cp, 1, 32, n_prefix, -16);
+
+        const llama_token next = 5;
+        const std::vector<float> logits_0 = eval_seq(ctx_cp, &next, 1, n_prefix,      0);
+        const std::vector<float> logits_1 = eval_seq(ctx_cp, &next, 1, n_prefix - 16, 1);
+
+        llama_free(ctx_cp);
+
+        llama_context * ctx_ref = llama_new_context_with_model(model, lparams);
+        assert(ctx_ref != NULL);
+
+        eval_seq(ctx_ref, tokens.data(), n_prefix, 0, 0);
+        assert(logits_close(logits_0, eval_seq(ctx_ref, &next, 1, n_prefix, 0)));
+
+        llama_kv_cache_seq_rm   (ctx_ref, 0, n_prefix, -1);
+        llama_kv_cache_seq_rm   (ctx_ref, 0, 16, 32);
+        llama_kv_cache_seq_shift(ctx_ref, 0, 32, n_prefix, -16);
+        assert(logits_close(logits_1, eval_seq(ctx_ref, &next, 1, n_prefix - 16, 0)));
+
+        llama_free(ctx_ref);
+    }
+
+    // removing most of a full cache gives back its storage, the cells that are left keep their data: sequence 1
+    // fills the cache past its first two sizes, then the cells of sequence 0 come after it and are compacted to
+    // the front of the smaller storage once sequence 1 is removed
+    {
+        const int n_keep = 64;
+        const int n_fill = n_prompt - n_keep;
+
+        llama_context * ctx_rm = llama_new_context_with_model(model, lparams);
+        assert(ctx_rm != NULL);
+
+        for (int i = 0; i < n_fill; i += lparams.n_batch) {
+            const int n = std::min(n_fill - i, lparams.n_batch);
+            eval_seq(ctx_rm, tokens.data() + i, n, i, 1);
+        }
+        eval_seq(ctx_rm, tokens.data(), n_keep, 0, 0);
+
+        llama_kv_cache_seq_rm(ctx_rm, 1, -1, -1);
+        assert(llama_get_kv_cache_token_count(ctx_rm) == n_keep);
+
+        const llama_token next = 5;
+        const std::vector<float> logits_rm = eval_seq(ctx_rm, &next, 1, n_keep, 0);
+
+        llama_free(ctx_rm);
+
+        llama_context * ctx_ref = llama_new_context_with_model(model, lparams);
+        assert(ctx_ref != NULL);
+
+        eval_seq(ctx_ref, tokens.data(), n_keep, 0, 0);
+        assert(logits_close(logits_rm, eval_seq(ctx_ref, &next, 1, n_keep, 0)));
+
+        llama_free(ctx_ref);
+    }
+
+    // the state keeps the positions and sequences of the cells: a sequence with a removed range and a pending
+    // shift, and a second sequence sharing its cells, are restored as they are
+    {
+        const int n_past = 100;
+
+        llama_context * ctx_src = llama_new_context_with_model(model, lparams);
+        assert(ctx_src != NULL);
+
+        eval_seq(ctx_src, tokens.data(), n_past, 0, 0);
+        llama_kv_cache_seq_rm   (ctx_src, 0, 10, 50);
+        llama_kv_cache_seq_shift(ctx_src, 0, 50, n_past, -40);
+        llama_kv_cache_seq_cp   (ctx_src, 0, 1, -1, -1);
+
+        const llama_token next = 5;
+        eval_seq(ctx_src, &next, 1, n_past - 40, 1);
+        assert(llama_get_kv_cache_token_count(ctx_src) == n_past - 40 + 1);
+
+        std::vector<uint8_t> state_src(llama_get_state_size(ctx_src));
+        const size_t n_state_src = llama_copy_state_data(ctx_src, state_src.data());
+        assert(n_state_src <= state_src.size());
+
+        llama_context * ctx_dst = llama_new_context_with_model(model, lparams);
+        assert(ctx_dst != NULL);
+
+        assert(llama_set_state_data(ctx_dst, state_src.data()) == n_state_src);
+        assert(llama_get_kv_cache_token_count(ctx_dst) == n_past - 40 + 1);
+
+        assert(eval_seq(ctx_dst, &next, 1, n_past - 40, 0) == eval_seq(ctx_src, &next, 1, n_past - 40, 0));
+        assert(eval_seq(ctx_dst, &next, 1, n_past - 39, 1) == eval_seq(ctx_src, &next, 1, n_past - 39, 1));
+
+        llama_free(ctx_dst);
+        llama_free(ctx_src);
+    }
+
+    // fill the cache of the first context past its first two sizes
+    llama_context * ctx = llama_new_context_with_model(model, lparams);
+    assert(ctx != NULL);
+
+    for (int i = 0; i < n_prompt; i += lparams.n_batch) {
+        const int n = std::min(n_prompt - i, lparams.n_batch);
+        assert(llama_eval(ctx, tokens.data() + i, n, i, 2) == 0);
+    }
+
+    std::vector<uint8_t> state(llama_get_state_size(ctx));
+    const size_t n_state = llama_copy_state_data(ctx, state.data());
+    assert(n_state <= state.size());
+
+    assert(llama_save_session_file(ctx, fname_session, tokens.data(), tokens.size()));
+
+    const std::vector<float> logits_ref = eval_next(ctx, 5, n_prompt);
+
+    // a fresh context has a smaller cache, the size of the state must not depend on it
+    {
+        llama_context * ctx_set = llama_new_context_with_model(model, lparams);
+        assert(ctx_set != NULL);
+        assert(llama_get_state_size(ctx_set) >= n_state);
+
+        assert(llama_set_state_data(ctx_set, state.data()) == n_state);
+        assert(llama_get_kv_cache_token_count(ctx_set) == n_prompt);
+        assert(eval_next(ctx_set, 5, n_prompt) == logits_ref);
+
+        llama_free(ctx_set);
+    }
+
+    {
+        llama_context * ctx_load = llama_new_context_with_model(model, lparams);
+        assert(ctx_load != NULL);
+
+        std::vector<llama_token> tokens_load(n_ctx);
+        size_t n_token_count = 0;
+        assert(llama_load_session_file(ctx_load, fname_session, tokens_load.data(), tokens_load.size(), &n_token_count));
+        assert(n_token_count == tokens.size());
+        assert(std::equal(tokens.begin(), tokens.end(), tokens_load.begin()));
+        assert(eval_next(ctx_load, 5, n_prompt) == logits_ref);
+
+        llama_free(ctx_load);
+    }
+
+    // the cells are restored as they are stored, a context whose cache has other types or another V layout rejects them
+    {
+        auto lparams_f16 = lparams;
+        lparams_f16.type_k = GGML_TYPE_F16;
+        lparams_f16.type_v = GGML_TYPE_F16;
+
+        llama_context * ctx_f16 = llama_new_context_with_model(model, lparams_f16);
+        assert(ctx_f16 != NULL);
+
+        std::vector<llama_token> tokens_load(n_ctx);
+        size_t n_token_count = 0;
+        assert(!llama_load_session_file(ctx_f16, fname_session, tokens_load.data(), tokens_load.size(), &n_token_count));
+        assert(llama_set_state_data(ctx_f16, state.data()) == 0);
+
+        llama_free(ctx_f16);
+
+        // same types, but V transposed instead of stored in rows
+        auto lparams_trans = lparams;
+        lparams_trans.v_rows = !lparams.v_rows;
+
+        llama_context * ctx_trans = llama_new_context_with_model(model, lparams_trans);
+        assert(ctx_trans != NULL);
+
+        assert(!llama_load_session_file(ctx_trans, fname_session, tokens_load.data(), tokens_load.size(), &n_token_count));
+        assert(llama_set_state_data(ctx_trans, state.data()) == 0);
+
+        llama_free(ctx_trans);
+    }
+
+    llama_free(ctx);
+    llama_free_model(model);
+
+    remove(fname_model);
+    remove(fname_session);
+
+    return 0;
+}